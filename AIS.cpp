@@ -20,6 +20,11 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
 #include "AIS.h"
 
 // Sources:
@@ -32,11 +37,8 @@ namespace AIS
 	Decoder::Decoder()
 	{
 		DataFCS.resize(MaxBits / 8, 0);
-	}
-
-	char Decoder::NMEAchar(int i)
-	{
-		return i < 40 ? (char)(i + 48) : (char)(i + 56);
+		Reliability.resize(MaxBits, 0.0f);
+		CRCbytes.resize(MaxBits / 8 + 1, 0xFFFF);
 	}
 
 	void Decoder::setBit(int i, bool b)
@@ -52,13 +54,6 @@ namespace AIS
 		return DataFCS[i >> 3] & (1 << (i & 7));
 	}
 
-	int Decoder::NMEAchecksum(std::string s)
-	{
-		int check = 0;
-		for(char c : s) check ^= c;
-		return check;
-	}
-
 	void Decoder::NextState(State s, int pos)
 	{
 		state = s;
@@ -69,20 +64,224 @@ namespace AIS
 		{
 		case State::TRAINING: DecoderMessage.Send(DecoderMessages::StartTraining); break;
 		case State::STARTFLAG: DecoderMessage.Send(DecoderMessages::StopTraining); break;
-		case State::FOUNDMESSAGE: DecoderMessage.Send(DecoderMessages::Reset); break;
+		case State::DATAFCS: nCRCbytes = 0; failed_frame = false; frame_start = symbols > 8 ? symbols - 8 : 0; break;
+		// a corrected frame is passed on but does not feed back to the demodulator (e.g. a frequency estimate)
+		case State::FOUNDMESSAGE: DecoderMessage.Send(flips ? DecoderMessages::StartTraining : DecoderMessages::Reset); break;
+		case State::SUSPENDED: DecoderMessage.Send(DecoderMessages::Suspend); break;
 		default: break;
 		}
 	}
 
-	bool Decoder::CRC16(int len)
+	static const uint16_t CRCchecksum = ~0x0F47, CRCpoly = 0x8408;
+
+	// byte-wise table for the reflected CRC, bits are stored LSB first in DataFCS
+	static const std::array<uint16_t, 256> CRCtable = []()
+	{
+		std::array<uint16_t, 256> t;
+
+		for (int b = 0; b < 256; b++)
+		{
+			uint16_t CRC = b;
+			for (int i = 0; i < 8; i++)
+				CRC = CRC & 1 ? (CRC >> 1) ^ CRCpoly : CRC >> 1;
+			t[b] = CRC;
+		}
+		return t;
+	}();
+
+	uint16_t Decoder::CRC16(int len)
+	{
+ 		uint16_t CRC = CRCbytes[len >> 3];
+
+ 		for(int i = len & ~7; i < len; i++)
+ 			CRC = (getBit(i) ^ CRC) & 1 ? (CRC >> 1) ^ CRCpoly : CRC >> 1;
+
+		return CRC;
+	}
+
+	// The CRC is linear: flipping bit i changes the final register by a syndrome that only depends on len - i.
+	// Each combination of flips is tested with a few XORs instead of a full CRC over the frame.
+	bool Decoder::repairCRC(int len, uint16_t CRC)
+	{
+		// a match can flip the message type, so the length is checked again once the flips are applied
+		int n = std::min(repair_bits, MaxRepairBits);
+		int idx[MaxRepairBits];
+		uint16_t syndrome[MaxRepairBits];
+
+		if (n > len) n = len;
+
+		// the n least reliable positions, insertion into a short sorted list
+		for (int i = 0, k = 0; i < len; i++)
+		{
+			int j = k < n ? k++ : n;
+
+			while (j > 0 && Reliability[idx[j - 1]] > Reliability[i])
+			{
+				if (j < n) idx[j] = idx[j - 1];
+				j--;
+			}
+			if (j < n) idx[j] = i;
+		}
+
+		// syndrome of a flip at position i, propagated with zero input to the end of the frame
+		uint16_t s = CRCpoly;
+		for (int i = len - 1; i >= 0; i--)
+		{
+			for (int j = 0; j < n; j++)
+				if (idx[j] == i) syndrome[j] = s;
+
+			s = s & 1 ? (s >> 1) ^ CRCpoly : s >> 1;
+		}
+
+		uint16_t target = CRC ^ CRCchecksum;
+
+		// fewest flips first
+		for (int w = 1; w <= n; w++)
+		{
+			for (int mask = 1; mask < (1 << n); mask++)
+			{
+				int c = 0;
+				for (int m = mask; m; m &= m - 1) c++;
+				if (c != w) continue;
+
+				uint16_t x = 0;
+				for (int j = 0; j < n; j++)
+					if (mask & (1 << j)) x ^= syndrome[j];
+
+				if (repair_stats) repair_stats->evaluations++;
+
+				if (x == target)
+				{
+					for (int j = 0; j < n; j++)
+						if (mask & (1 << j)) setBit(idx[j], !getBit(idx[j]));
+
+					if (validLength(len))
+					{
+						if (repair_stats) repair_stats->repaired++;
+						flips = w;
+						return true;
+					}
+
+					for (int j = 0; j < n; j++)
+						if (mask & (1 << j)) setBit(idx[j], !getBit(idx[j]));
+				}
+			}
+		}
+		return false;
+	}
+
+	// Syndrome of a single flipped bit by its distance to the end of the frame. As the syndrome only depends on
+	// the distance, one table serves all frame lengths up to MaxBits. The inverse maps a syndrome back to the
+	// distance (or -1), the CRC-16 period is far longer than a frame so the single bit syndromes are distinct.
+	static const int MaxSyndromeDistance = 512;
+
+	static const std::array<uint16_t, MaxSyndromeDistance> Syndrome = []()
+	{
+		std::array<uint16_t, MaxSyndromeDistance> t;
+
+		uint16_t s = CRCpoly;
+		for (int d = 0; d < MaxSyndromeDistance; d++)
+		{
+			t[d] = s;
+			s = s & 1 ? (s >> 1) ^ CRCpoly : s >> 1;
+		}
+		return t;
+	}();
+
+	static const std::vector<int16_t> SyndromeDistance = []()
+	{
+		std::vector<int16_t> t(1 << 16, -1);
+
+		for (int d = MaxSyndromeDistance - 1; d >= 0; d--)
+			t[Syndrome[d]] = d;
+		return t;
+	}();
+
+	// A wrong correction still passes the CRC, so corrected frames are only accepted for the message
+	// types with a fixed length and only if the (corrected) type matches the length of the frame.
+	bool Decoder::validLength(int len)
+	{
+		int nbits = len - 16;
+
+		switch (DataFCS[0] >> 2)
+		{
+		case 1: case 2: case 3: case 4: case 9: case 11: case 18: return nbits == 168;
+		case 5: return nbits == 424;
+		case 19: return nbits == 312;
+		case 24: return nbits == 160 || nbits == 168;
+		case 27: return nbits == 96;
+		default: return false;
+		}
+	}
+
+	// A double error is only accepted if both bits are among the DoubleRank least reliable of the frame. About one in
+	// four frames with more errors has some pair with a matching syndrome, but that pair is rarely this unreliable.
+	static const int DoubleRank = 8;
+
+	bool Decoder::correctCRC(int len, uint16_t CRC)
 	{
-		const uint16_t checksum = ~0x0F47, poly = 0x8408;
- 		uint16_t CRC = 0xFFFF;
+		uint16_t target = CRC ^ CRCchecksum;
+		int limit = std::min(len, MaxSyndromeDistance);
+
+		// single bit error: one lookup
+		int d = SyndromeDistance[target];
+
+		if (d >= 0 && d < limit)
+		{
+			int i = len - 1 - d;
+
+			setBit(i, !getBit(i));
+			if (validLength(len))
+			{
+				if (repair_stats) repair_stats->corrected1++;
+				flips = 1;
+				return true;
+			}
+			setBit(i, !getBit(i));
+		}
+
+		if (correct_bits < 2) return false;
+
+		// two bit errors: one lookup per first position, the least reliable pair if there are several
+		int best_i = -1, best_j = -1;
+		FLOAT32 best_r = 0.0f;
+
+		for (int d1 = 0; d1 < limit; d1++)
+		{
+			int d2 = SyndromeDistance[target ^ Syndrome[d1]];
+
+			if (d2 > d1 && d2 < limit)
+			{
+				int i = len - 1 - d1, j = len - 1 - d2;
+				FLOAT32 r = Reliability[i] + Reliability[j];
+
+				if (best_i < 0 || r < best_r)
+				{
+					best_i = i; best_j = j; best_r = r;
+				}
+			}
+		}
+
+		if (best_i < 0) return false;
+
+		FLOAT32 worst = std::max(Reliability[best_i], Reliability[best_j]);
+		int rank = 0;
 
- 		for(int i = 0; i < len; i++)
- 			CRC = (getBit(i) ^ CRC) & 1 ? (CRC >> 1) ^ poly : CRC >> 1;
+		for (int i = 0; i < len; i++)
+			if (Reliability[i] <= worst) rank++;
 
-		return CRC == checksum;
+		if (rank <= DoubleRank)
+		{
+			setBit(best_i, !getBit(best_i)); setBit(best_j, !getBit(best_j));
+			if (validLength(len))
+			{
+				if (repair_stats) repair_stats->corrected2++;
+				flips = 2;
+				return true;
+			}
+			setBit(best_i, !getBit(best_i)); setBit(best_j, !getBit(best_j));
+		}
+		return false;
 	}
 
 	char Decoder::getLetter(int pos)
@@ -98,45 +297,108 @@ namespace AIS
 		return (w >> (16 - 6 - y)) & mask;
 	}
 
+	// 6-bit armoring of the payload and hex digits of the checksum
+	static const char NMEAchar[64 + 1] = "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVW`abcdefghijklmnopqrstuvw";
+	static const char HEXchar[16 + 1] = "0123456789ABCDEF";
+
 	void Decoder::sendNMEA()
 	{
-		std::string sentence;
-		const std::string comma = ",";
 		NMEA nmea;
 
 		int nAISletters = (nBits + 6 - 1) / 6;
 		int nSentences = (nAISletters + 56 - 1) / 56;
 
+		if (nSentences > NMEA::MaxSentences) return;
+
 		for (int s = 0, l = 0; s < nSentences; s++)
 		{
-			sentence = std::string("AIVDM,") + std::to_string(nSentences) + comma + std::to_string(s + 1) + comma;
-			sentence += (nSentences > 1 ? std::to_string(MessageID) : "") + comma + channel + comma;
+			char* p = nmea.sentence[s];
+			char* begin = p + 1;
+
+			// sentence counts and fill bits are single digits for frames up to MaxBits
+			memcpy(p, "!AIVDM,", 7); p += 7;
+			*p++ = '0' + nSentences; *p++ = ',';
+			*p++ = '0' + s + 1; *p++ = ',';
+			if (nSentences > 1) *p++ = '0' + MessageID;
+			*p++ = ','; *p++ = channel; *p++ = ',';
 
 			for (int i = 0; l < nAISletters && i < 56; i++, l++)
-				sentence += NMEAchar(getLetter(l));
+				*p++ = NMEAchar[getLetter(l)];
 
-			sentence += comma + std::to_string( (nSentences > 1 && s == nSentences - 1) ? nAISletters * 6 - nBits : 0);
+			*p++ = ',';
+			*p++ = '0' + ((nSentences > 1 && s == nSentences - 1) ? nAISletters * 6 - nBits : 0);
 
-			char hex[3]; sprintf(hex, "%02X", NMEAchecksum(sentence));
-			sentence += std::string("*") + hex;
+			char check = 0;
+			for (char* c = begin; c < p; c++) check ^= *c;
 
-			nmea.sentence.push_back("!" + sentence);
+			*p++ = '*'; *p++ = HEXchar[(check >> 4) & 0xF]; *p++ = HEXchar[check & 0xF];
+
+			nmea.length[s] = (int)(p - nmea.sentence[s]);
+			*p++ = '\r'; *p++ = '\n'; *p = 0;
 		}
 
+		nmea.nSentences = nSentences;
 		nmea.channel = channel;
 		nmea.msg = DataFCS[0] >> 2;
 		nmea.repeat = DataFCS[0] & 3;
 		nmea.mmsi = (DataFCS[1]<<22)|(DataFCS[2]<<14)|(DataFCS[3]<<6)|(DataFCS[4]>>2);
+		nmea.corrected = flips;
+
+		memcpy(nmea.payload, DataFCS.data(), nBytes);
+		memset(nmea.payload + nBytes, 0, NMEA::MaxPayload - nBytes);
+		nmea.nBits = nBits;
+
+		// signal and noise from the reliabilities of the frame bits, which are only kept for a frame anyway
+		FLOAT32 sum = 0.0f, sum2 = 0.0f;
+		int len = nBits + 16;
+
+		for (int i = 0; i < len; i++)
+		{
+			sum += Reliability[i];
+			sum2 += Reliability[i] * Reliability[i];
+		}
+
+		FLOAT32 mean = sum / len;
+
+		// hard decisions (e.g. the Viterbi model) give a variance of exactly 0 and rounding can take it below,
+		// both powers are floored at -100 dB
+		const FLOAT32 MinPower = 1e-10f;
+
+		nmea.start = frame_start;
+		nmea.signal = std::max(mean * mean, MinPower);
+		nmea.noise = std::max(sum2 / len - mean * mean, MinPower);
+		nmea.lane = lane;
+		nmea.offset = 0.0f;
+		nmea.model = 0;
 
 		sendOut(&nmea, 1);
 
 		MessageID = (MessageID + 1) % 10;
 	}
 
+	// data lengths of the fixed length message types, the only frames that are corrected or repaired
+	static bool plausibleLength(int nbits)
+	{
+		return nbits == 96 || nbits == 160 || nbits == 168 || nbits == 312 || nbits == 424;
+	}
+
 	bool Decoder::processData(int len)
 	{
-		if(len > 16 && CRC16(len))
+		if(len <= 16) return false;
+
+		uint16_t CRC = CRC16(len);
+		flips = 0;
+
+		// an end flag at any other length is noise or a broken frame, searching for flips there only adds false accepts
+		if (CRC != CRCchecksum)
 		{
+			if (!plausibleLength(len - 16)) return false;
+			failed_frame = true;
+		}
+
+		if(CRC == CRCchecksum || (correct_bits > 0 && correctCRC(len, CRC)) || (repair_bits > 0 && repairCRC(len, CRC)))
+		{
+
 			nBits = len - 16;
 			nBytes = (nBits + 7)/8;
 
@@ -157,68 +419,261 @@ namespace AIS
 		}
 	}
 
+	// one bit inside a frame: store, destuff, checkpoint the CRC and test for the end flag
+	State Decoder::frameBit(BIT Bit, FLOAT32 r)
+	{
+		Reliability[position] = r;
+		setBit(position++, Bit);
+
+		if (Bit == 1)
+		{
+			if (one_seq_count == 5)
+			{
+				bool found = processData(position - 7);
+
+				if (found) NextState(State::FOUNDMESSAGE, 0);
+				NextState(State::TRAINING, 0);
+
+				return found ? State::FOUNDMESSAGE : State::TRAINING;
+			}
+			one_seq_count++;
+		}
+		else
+		{
+			if (one_seq_count == 5) position--; // bit-destuff
+			one_seq_count = 0;
+		}
+
+		// checkpoint once a byte is complete, after destuffing so it holds data bits only
+		if (position == (nCRCbytes + 1) * 8)
+		{
+			CRCbytes[nCRCbytes + 1] = (CRCbytes[nCRCbytes] >> 8) ^ CRCtable[(CRCbytes[nCRCbytes] ^ DataFCS[nCRCbytes]) & 0xFF];
+			nCRCbytes++;
+		}
+
+		if (position == MaxBits) NextState(State::TRAINING, 0);
+
+		return state;
+	}
+
+	void Decoder::step(FLOAT32 x)
+	{
+		// NRZI, the bit is only as reliable as the weakest of the two symbols
+		FLOAT32 a = std::abs(x);
+		FLOAT32 r = a < prev_abs ? a : prev_abs;
+		prev_abs = a;
+
+		BIT d = x > 0;
+		BIT Bit = !(d ^ prev);
+		prev = d;
+
+		symbols++;
+
+		// State machine
+		// At this stage: "position" bits into sequence, inspect the next bit:
+		switch (state)
+		{
+		case State::TRAINING:
+			if (Bit != lastBit) // 01 10
+			{
+				position++;
+			}
+			else // 11 or 00
+			{
+				if (position > 5) NextState(State::STARTFLAG, Bit ? 3 : 1); // we are at * in ..0101|01*111110 ..010|*01111110
+				else NextState(State::TRAINING, 0);
+			}
+			break;
+		case State::STARTFLAG:
+
+			if (position == 7)
+			{
+				if (Bit == 0) NextState(State::DATAFCS, 0); // 0111111*0....
+				else NextState(State::TRAINING, 0);
+			}
+			else
+			{
+				if (Bit == 1) position++;
+				else NextState(State::TRAINING, 0);
+			}
+			break;
+		case State::DATAFCS:
+			if (frameBit(Bit, r) != State::DATAFCS && failed_frame && repair_stats) repair_stats->failed++;
+			break;
+		default:
+			break;
+		}
+		lastBit = Bit;
+	}
+
 	void Decoder::Receive(const FLOAT32* data, int len)
 	{
-		for (int i = 0; i < len; i++)
+		for (int i = 0; i < len && state != State::SUSPENDED; i++) step(data[i]);
+	}
+
+	void DecoderParallel::setLanes(int n)
+	{
+		if (n > MaxLanes) throw "Too many timing buckets and frequency hypotheses for one decoder.";
+
+		nLanes = n;
+		all = n == MaxLanes ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+
+		decoders.resize(n);
+		for (int k = 0; k < n; k++)
 		{
-			// NRZI
-			BIT d = data[i] > 0;
-			BIT Bit = !(d ^ prev);
-			prev = d;
+			decoders[k].setLane(k);
+			decoders[k] >> *this;
+		}
+
+		lanes.clear();
+		for (int k = 0; k < n; k++) lanes.push_back(Lane(this, k));
+
+		soft.assign(n, 0.0f);
+		prev_abs.assign(n, 0.0f);
+		reliability.assign(n, 0.0f);
+		quality.assign(n, 0.0f);
+	}
+
+	// the lanes of one symbol arrive in order, a lane index that does not increase starts the next symbol
+	// when the last lanes are suspended
+	void DecoderParallel::receiveLane(int k, FLOAT32 x)
+	{
+		if (k <= last_lane) processLanes();
+
+		soft[k] = x;
+		received |= (uint64_t)1 << k;
+		last_lane = k;
+
+		// all lanes in, process now so the messages reach the demodulators before their next symbol
+		if (k == nLanes - 1) processLanes();
+	}
+
+	// a frame was found or all lanes left their frame: resume suspended lanes and restart the search
+	void DecoderParallel::resetLanes()
+	{
+		for (int k = 0; k < nLanes; k++)
+			if (((inframe | suspended | flagging) >> k) & 1) decoders[k].reset();
+
+		inframe = suspended = flagging = 0;
+		frame_failed = false;
+		best_quality = 0.0f;
+		prune_wait = 0;
+	}
+
+	void DecoderParallel::processLanes()
+	{
+		if (!received) return;
 
-			// State machine
-			// At this stage: "position" bits into sequence, inspect the next bit:
-			switch (state)
+		uint64_t d = 0;
+		symbols++;
+
+		for (int k = 0; k < nLanes; k++)
+		{
+			if (!((received >> k) & 1)) continue;
+
+			// NRZI, the bit is only as reliable as the weakest of the two symbols
+			FLOAT32 a = std::abs(soft[k]);
+			reliability[k] = a < prev_abs[k] ? a : prev_abs[k];
+			prev_abs[k] = a;
+
+			if (soft[k] > 0) d |= (uint64_t)1 << k;
+			if (pruning) quality[k] += QualityWeight * (reliability[k] - quality[k]);
+		}
+
+		// lanes without a symbol (suspended demodulators) keep their last value
+		d = (d & received) | (prev & ~received);
+
+		uint64_t Bit = ~(d ^ prev) & all;
+		prev = d;
+
+		t = (t + 1) & (nHistory - 1);
+		hist[t] = Bit;
+
+		// a repeated bit after at least 6 transitions ends the training sequence and the lane enters the start flag,
+		// which completes as 01111110 or is broken by a 0 or a seventh 1 earlier
+		uint64_t entry = ~(H(0) ^ H(1)) & (H(1) ^ H(2)) & (H(2) ^ H(3)) & (H(3) ^ H(4)) & (H(4) ^ H(5)) & (H(5) ^ H(6)) & (H(6) ^ H(7));
+		uint64_t flag = ~H(7) & H(6) & H(5) & H(4) & H(3) & H(2) & H(1) & ~H(0);
+
+		// suspended lanes may still deliver symbols (models without a demodulator to suspend) but take no part
+		uint64_t start = flagging & flag & received & ~suspended;
+		uint64_t broken = flagging & ~start & received & ~suspended & (~H(0) | (H(0) & H(1) & H(2) & H(3) & H(4) & H(5) & H(6)));
+
+		entry &= received & ~inframe & ~suspended & ~flagging;
+
+		uint64_t active = inframe & received;
+
+		for (int k = 0; active; k++, active >>= 1)
+		{
+			if (!(active & 1)) continue;
+
+			State s = decoders[k].frameBit((Bit >> k) & 1, reliability[k]);
+
+			if (s == State::FOUNDMESSAGE)
 			{
-			case State::TRAINING:
-				if (Bit != lastBit) // 01 10
-				{
-					position++;
-				}
-				else // 11 or 00
-				{
-					if (position > 5) NextState(State::STARTFLAG, Bit ? 3 : 1); // we are at * in ..0101|01*111110 ..010|*01111110
-					else NextState(State::TRAINING, 0);
-				}
-				break;
-			case State::STARTFLAG:
+				// the other lanes carry the same frame
+				if (decoders[k].failedFrame() && repair_stats) repair_stats->failed++;
 
-				if (position == 7)
-				{
-					if (Bit == 0) NextState(State::DATAFCS, 0); // 0111111*0....
-					else NextState(State::TRAINING, 0);
-				}
-				else
-				{
-					if (Bit == 1) position++;
-					else NextState(State::TRAINING, 0);
-				}
+				inframe &= ~((uint64_t)1 << k);
+				resetLanes();
+				for (int j = 0; j < nHistory; j++) hist[j] = 0;
+				start = entry = broken = 0;
 				break;
-			case State::DATAFCS:
+			}
+			else if (s != State::DATAFCS)
+			{
+				inframe &= ~((uint64_t)1 << k);
+				if (decoders[k].failedFrame()) frame_failed = true;
+			}
+		}
 
-				setBit(position++,Bit);
+		// the lanes carry the same frame, a failure is counted once all of them have left it
+		if (frame_failed && !inframe)
+		{
+			if (repair_stats) repair_stats->failed++;
+			frame_failed = false;
+		}
 
-				if (Bit == 1)
-				{
-					if (one_seq_count == 5)
-					{
-						if( processData(position - 7))
-							NextState(State::FOUNDMESSAGE, 0);
-						NextState(State::TRAINING, 0);
-					}
-					else
-						one_seq_count++;
-				}
-				else
-				{
-					if (one_seq_count == 5) position--; // bit-destuff
-					one_seq_count = 0;
-				}
+		if (broken | entry)
+		{
+			for (int k = 0; k < nLanes; k++)
+			{
+				if ((broken >> k) & 1) decoders[k].reset();
+				if ((entry >> k) & 1) decoders[k].startFlag();
+			}
+			flagging = (flagging & ~broken) | entry;
+		}
 
-				if (position == MaxBits) NextState(State::TRAINING, 0);
-				break;
+		if (start)
+		{
+			flagging &= ~start;
+
+			for (int k = 0; k < nLanes; k++)
+			{
+				if (!((start >> k) & 1)) continue;
+
+				decoders[k].startFrame(symbols);
+				if (quality[k] > best_quality) best_quality = quality[k];
 			}
-			lastBit = Bit;
+			inframe |= start;
+
+			if (pruning && !prune_wait) prune_wait = PruneDelay + 1;
 		}
+
+		// once a lane with a clearly better eye opening is in a frame, the others are suspended until it ends,
+		// after a short wait as the buckets next to a symbol boundary see the flag one symbol later
+		if (prune_wait && --prune_wait == 0)
+		{
+			for (int k = 0; k < nLanes; k++)
+			{
+				if ((((suspended | inframe) >> k) & 1) || quality[k] >= PruneMargin * best_quality) continue;
+
+				decoders[k].suspend();
+				suspended |= (uint64_t)1 << k;
+			}
+		}
+
+		if (!inframe && suspended) resetLanes();
+
+		received = 0;
 	}
 }
@@ -28,7 +28,17 @@ SOFTWARE.
 
 namespace AIS
 {
-	enum class State { TRAINING, STARTFLAG, STOPFLAG, DATAFCS, FOUNDMESSAGE };
+	enum class State { TRAINING, STARTFLAG, STOPFLAG, DATAFCS, FOUNDMESSAGE, SUSPENDED };
+
+	// instrumentation of the bit flip search and the syndrome correction on frames that fail the CRC
+	struct RepairStatistics
+	{
+		uint64_t failed = 0;
+		uint64_t evaluations = 0;
+		uint64_t repaired = 0;
+		uint64_t corrected1 = 0;
+		uint64_t corrected2 = 0;
+	};
 
 	class Decoder : public SimpleStreamInOut<FLOAT32, NMEA>, public MessageIn<DecoderMessages>
 	{
@@ -36,8 +46,29 @@ namespace AIS
 
 		std::vector<uint8_t> DataFCS;
 
+		// reliability of each bit in DataFCS, the smaller of the two soft values that make up the NRZI bit
+		std::vector<FLOAT32> Reliability;
+		FLOAT32 prev_abs = 0.0f;
+
+		// on a CRC failure try all combinations of flips of the repair_bits least reliable bits
+		static const int MaxRepairBits = 10;
+		int repair_bits = 0;
+		RepairStatistics* repair_stats = nullptr;
+
+		// on a CRC failure locate up to correct_bits (1 or 2) errors anywhere in the frame from the syndrome
+		int correct_bits = 0;
+		int flips = 0;
+
+		// the CRC of the current frame failed at the length of a fixed length type (whether or not it was repaired)
+		bool failed_frame = false;
+
 		const int MaxBits = 512;
 
+		// CRC register at each byte boundary of DataFCS, updated as bits are written so a candidate end flag
+		// only needs the last checkpoint and at most 7 bit steps
+		std::vector<uint16_t> CRCbytes;
+		int nCRCbytes = 0;
+
 		State state = State::TRAINING;
 
 		BIT lastBit = 0;
@@ -50,15 +81,22 @@ namespace AIS
 		int position = 0;
 		int one_seq_count = 0;
 
+		// symbols received and the symbol at the start of the current frame's start flag
+		uint64_t symbols = 0;
+		uint64_t frame_start = 0;
+		int lane = 0;
+
 		void setBit(int i, bool b);
 		bool getBit(int i);
 
 		void NextState(State s, int pos);
-		char NMEAchar(int i);
-		int NMEAchecksum(std::string);
+		void step(FLOAT32 x);
 
 		void sendNMEA();
-		bool CRC16(int len);
+		uint16_t CRC16(int len);
+		bool repairCRC(int len, uint16_t CRC);
+		bool correctCRC(int len, uint16_t CRC);
+		bool validLength(int len);
 		char getLetter(int pos);
 		bool processData(int len);
 
@@ -67,11 +105,94 @@ namespace AIS
 		Decoder();
 
 		virtual void setChannel(char c) { channel = c; }
+		void setRepair(int bits, RepairStatistics* s) { repair_bits = bits; repair_stats = s; }
+		void setCorrection(int bits) { correct_bits = bits; }
+		void setLane(int k) { lane = k; }
+		bool failedFrame() { return failed_frame; }
 		void Receive(const FLOAT32* data, int len);
 
+		// frame level interface for DecoderParallel, which searches the start flag itself
+		void startFlag() { NextState(State::STARTFLAG, 0); }
+		void startFrame(uint64_t t) { symbols = t; if (state != State::STARTFLAG) NextState(State::STARTFLAG, 0); NextState(State::DATAFCS, 0); }
+		State frameBit(BIT Bit, FLOAT32 r);
+		void reset() { NextState(State::TRAINING, 0); }
+		void suspend() { NextState(State::SUSPENDED, 0); }
+
 		// MessageIn
 		virtual void Message(const DecoderMessages& in);
 		// MessageOut
 		MessageHub<DecoderMessages> DecoderMessage;
 	};
+
+	// One decoder for a bank of timing buckets (and frequency hypotheses), each input stream is a lane.
+	// The lanes are kept as bits in a machine word: NRZI and the search for training sequence and start flag
+	// run for all lanes at once with bitwise operations. Only lanes inside a frame are handed to a per lane
+	// Decoder for destuffing and CRC, and lanes are reset or suspended by direct calls instead of messages.
+	class DecoderParallel : public SimpleStreamInOut<NMEA, NMEA>
+	{
+		class Lane : public StreamIn<FLOAT32>
+		{
+			DecoderParallel* parent;
+			int lane;
+
+		public:
+			Lane(DecoderParallel* p, int k) : parent(p), lane(k) {}
+			void Receive(const FLOAT32* data, int len) { for (int i = 0; i < len; i++) parent->receiveLane(lane, data[i]); }
+		};
+
+		static const int MaxLanes = 64;
+		static const int nHistory = 16;
+		const FLOAT32 PruneMargin = 0.7f;
+		const int PruneDelay = 1;
+		const FLOAT32 QualityWeight = 1.0f / 16.0f;
+
+		int nLanes = 0;
+		uint64_t all = 0;
+
+		std::vector<Decoder> decoders;
+		std::vector<Lane> lanes;
+
+		std::vector<FLOAT32> soft, prev_abs, reliability, quality;
+		int last_lane = MaxLanes;
+		uint64_t received = 0;
+		uint64_t symbols = 0;
+
+		// NRZI decoded bits of all lanes, hist[t] is the latest
+		uint64_t hist[nHistory] = { };
+		int t = 0;
+		uint64_t prev = 0;
+
+		uint64_t flagging = 0;
+		uint64_t inframe = 0;
+		uint64_t suspended = 0;
+
+		RepairStatistics* repair_stats = nullptr;
+		bool frame_failed = false;
+
+		bool pruning = false;
+		FLOAT32 best_quality = 0.0f;
+		int prune_wait = 0;
+
+		uint64_t H(int j) { return hist[(t - j) & (nHistory - 1)]; }
+
+		void receiveLane(int k, FLOAT32 x);
+		void processLanes();
+		void resetLanes();
+
+	public:
+
+		void setLanes(int n);
+		void setChannel(char c) { for (auto& d : decoders) d.setChannel(c); }
+		void setRepair(int bits, RepairStatistics* s) { repair_stats = s; for (auto& d : decoders) d.setRepair(bits, s); }
+		void setCorrection(int bits) { for (auto& d : decoders) d.setCorrection(bits); }
+		void setPruning(bool b) { pruning = b; }
+
+		StreamIn<FLOAT32>& in(int k) { return lanes[k]; }
+
+		// per lane messages to the demodulator and timing loop of that lane
+		MessageHub<DecoderMessages>& LaneMessage(int k) { return decoders[k].DecoderMessage; }
+
+		// frames from the lanes
+		void Receive(const NMEA* data, int len) { sendOut(data, len); }
+	};
 }
@@ -23,6 +23,7 @@ SOFTWARE.
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <complex>
 
 #ifdef WIN32
@@ -43,7 +44,33 @@ typedef std::complex <int32_t> CS32;
 typedef std::complex <int16_t> CS16;
 typedef std::complex <uint8_t> CU8;
 typedef char BIT;
-typedef struct { std::vector<std::string> sentence; char channel; int msg; uint32_t mmsi; int repeat; } NMEA;
+
+// decoded message with its sentences in fixed buffers, each terminated by CR LF and a zero, length excludes CR LF
+struct NMEA
+{
+	static const int MaxSentences = 3;
+	static const int MaxLength = 82;
+
+	char sentence[MaxSentences][MaxLength + 3];
+	int length[MaxSentences];
+	int nSentences;
+
+	char channel; int msg; uint32_t mmsi; int repeat;
+
+	// payload bits of the frame (without FCS), first bit in the MSB of byte 0 and zero padded
+	static const int MaxPayload = 64;
+	uint8_t payload[MaxPayload];
+	int nBits;
+
+	// reception: symbol (1/9600 s) of the start flag counted from the start of the stream, frequency offset of
+	// the channel (Hz), signal and noise power at the bit decisions, lane (timing bucket) and model that caught it
+	uint64_t start;
+	float offset, signal, noise;
+	int lane, model;
+
+	// number of bits flipped to pass the CRC, 0 for a frame received without errors
+	int corrected;
+};
 
 using namespace std::chrono;
 
@@ -23,6 +23,7 @@ SOFTWARE.
 #include <chrono>
 #include <cassert>
 #include <complex>
+#include <algorithm>
 
 #include "FFT.h"
 #include "DSP.h"
@@ -268,6 +269,59 @@ namespace DSP
 	}
 	// Filter Generic
 
+	void ResampleComplex::setRates(int up, int down, int n)
+	{
+		L = up; M = down; nTaps = n;
+
+		// low pass at the lower of the two Nyquist frequencies, Blackman window, stored per phase
+		int N = L * nTaps;
+		double fc = 0.5 / std::max(L, M);
+		std::vector<FLOAT32> h(N);
+
+		for (int i = 0; i < N; i++)
+		{
+			double t = i - (N - 1) / 2.0;
+			double sinc = t == 0 ? 1.0 : sin(2 * PI * fc * t) / (2 * PI * fc * t);
+			double w = 0.42 - 0.5 * cos(2 * PI * i / (N - 1)) + 0.08 * cos(4 * PI * i / (N - 1));
+			h[i] = (FLOAT32)(2 * fc * L * sinc * w);
+		}
+
+		taps.resize(N);
+		for (int p = 0; p < L; p++)
+			for (int k = 0; k < nTaps; k++)
+				taps[p * nTaps + k] = h[k * L + p];
+
+		buffer.assign(nTaps, 0.0f);
+		phase = 0;
+	}
+
+	void ResampleComplex::Receive(const CFLOAT32* data, int len)
+	{
+		int j = 0;
+
+		if (output.size() < (size_t)(len * L / M + 1)) output.resize(len * L / M + 1);
+
+		for (int i = 0; i < len; i++)
+		{
+			// newest sample first
+			for (int k = nTaps - 1; k > 0; k--) buffer[k] = buffer[k - 1];
+			buffer[0] = data[i];
+
+			// outputs that fall in the L upsampled positions of this input sample
+			for (; phase < L; phase += M)
+			{
+				const FLOAT32* t = &taps[phase * nTaps];
+				CFLOAT32 x = 0.0f;
+
+				for (int k = 0; k < nTaps; k++) x += t[k] * buffer[k];
+				output[j++] = x;
+			}
+			phase -= L;
+		}
+
+		if (j > 0) sendOut(output.data(), j);
+	}
+
 	void FilterComplex::Receive(const CFLOAT32* data, int len)
 	{
 		int ptr, i, j;
@@ -339,22 +393,108 @@ namespace DSP
 		rot_down /= std::abs(rot_down);
 	}
 
+	// NRZ levels of the last 16 bits of the training sequence 0101... followed by the start flag 01111110
+	BurstDetector::BurstDetector()
+	{
+		const int levels[nReference] = { -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, -1, -1, -1, -1, -1, 1 };
+
+		for (int i = 0; i < nReference; i++) reference[i] = (FLOAT32)levels[i];
+		setSamplesPerSymbol(sps);
+	}
+
+	void BurstDetector::setSamplesPerSymbol(int s)
+	{
+		sps = s;
+
+		delay.assign(sps, 0.0f);
+		disc.assign(nReference * sps, 0.0f);
+		idx_delay = idx_disc = 0;
+	}
+
+	void BurstDetector::Receive(const CFLOAT32* data, int len)
+	{
+		const int nDisc = nReference * sps;
+		const FLOAT32 level = threshold * nReference;
+		bool detected = false;
+
+		for (int i = 0; i < len; i++)
+		{
+			// phase change over one symbol, scaled to [-1, 1] without a square root
+			const CFLOAT32& a = data[i];
+			const CFLOAT32& b = delay[idx_delay];
+
+			FLOAT32 im = a.imag() * b.real() - a.real() * b.imag();
+			FLOAT32 p = 0.5f * (std::norm(a) + std::norm(b)) + 1e-12f;
+
+			delay[idx_delay] = a;
+			if (++idx_delay == sps) idx_delay = 0;
+
+			disc[idx_disc] = im / p;
+			if (++idx_disc == nDisc) idx_disc = 0;
+
+			if (detected) continue;
+
+			// disc[idx_disc] is now the oldest value, one symbol apart up to the newest
+			FLOAT32 c = 0.0f;
+			for (int k = 0, j = idx_disc; k < nReference; k++)
+			{
+				c += reference[k] * disc[j];
+				j += sps; if (j >= nDisc) j -= nDisc;
+			}
+
+			if (std::abs(c) > level) detected = true;
+		}
+
+		blocks++;
+
+		if (detected)
+		{
+			if (!held_sent && !held.empty())
+			{
+				sendOut(held.data(), (int)held.size());
+				forwarded++;
+			}
+			remaining = MaxSymbols * sps;
+		}
+
+		held_sent = remaining > 0;
+
+		if (held_sent)
+		{
+			sendOut(data, len);
+			forwarded++;
+			remaining -= len;
+		}
+
+		held.assign(data, data + len);
+	}
+
 	// square the signal, find the mid-point between two peaks
 	void SquareFreqOffsetCorrection::correctFrequency()
 	{
-		FLOAT32 max_val = 0.0, fz = -1;
-		int delta = (int)9600.0 / 48000.0 * N;
+		if (hold > 0)
+		{
+			fz = fz_track;
+			hold--;
+		}
+		else
+		{
+			FLOAT32 max_val = 0.0;
+			int delta = (int)(9600.0 / sample_rate * N);
 
-		FFT::fft(fft_data);
+			fz = -1;
 
-		for(int i = window; i<N-window-delta; i++)
-		{
-			FLOAT32 h = std::abs(fft_data[(i + N / 2) % N]) + std::abs(fft_data[(i + delta + N / 2) % N]);
+			FFT::fft(fft_data);
 
-			if(h > max_val)
+			for(int i = window; i<N-window-delta; i++)
 			{
-				max_val = h;
-				fz = (N / 2 - (i + delta / 2.0));
+				FLOAT32 h = std::abs(fft_data[(i + N / 2) % N]) + std::abs(fft_data[(i + delta + N / 2) % N]);
+
+				if(h > max_val)
+				{
+					max_val = h;
+					fz = (N / 2 - (i + delta / 2.0));
+				}
 			}
 		}
 
@@ -376,6 +516,15 @@ namespace DSP
 		window = w;
 	}
 
+	// a frame was decoded with the current correction applied, refine the tracked offset
+	void SquareFreqOffsetCorrection::Message(const FrequencyCorrection& in)
+	{
+		FLOAT32 f = fz - in.offset * 2.0f * N / sample_rate;
+
+		fz_track = hold > 0 ? fz_track + 0.1f * (f - fz_track) : f;
+		hold = nHold;
+	}
+
 	void SquareFreqOffsetCorrection::Receive(const CFLOAT32* data, int len)
 	{
 		if(fft_data.size() < N) fft_data.resize(N);
@@ -383,7 +532,7 @@ namespace DSP
 
 		for(int i = 0; i< len; i++)
 		{
-			fft_data[FFT::rev(count, logN)] = data[i] * data[i];
+			if (hold == 0) fft_data[FFT::rev(count, logN)] = data[i] * data[i];
 			output[count] = data[i];
 
 			if(++count == N)
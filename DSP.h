@@ -23,6 +23,7 @@ SOFTWARE.
 #pragma once
 
 #include <assert.h>
+#include <cmath>
 
 #include "Stream.h"
 #include "Filters.h"
@@ -81,6 +82,126 @@ public:
     };
 
 
+	// timing signal for the interpolating sampler: the input itself for a discriminator output, otherwise the
+	// (amplitude weighted) instantaneous frequency of the complex baseband signal, which lags half a sample
+	static inline FLOAT32 timingSignal(const FLOAT32& x, const FLOAT32& prev) { return x; }
+	static inline FLOAT32 timingSignal(const CFLOAT32& x, const CFLOAT32& prev) { return x.imag() * prev.real() - x.real() * prev.imag(); }
+	static inline FLOAT32 timingDelay(const FLOAT32*) { return 0.0f; }
+	static inline FLOAT32 timingDelay(const CFLOAT32*) { return 0.5f; }
+
+	// Single symbol stream instead of parallel buckets: a cubic (Farrow) interpolator samples at the symbol centres
+	// estimated from the symbol rate line of the squared instantaneous frequency (Oerder-Meyr). Optional neighbours
+	// are sampled one input sample either side.
+	template<typename T>
+	class SamplerInterpolating : public StreamIn<T>, public MessageIn<DecoderMessages>
+	{
+		static const int nRing = 16;
+
+		T hist[nRing] = { };
+		int w = 0;
+
+		int sps = 5;
+		int phase = 0;
+		std::vector<FLOAT32> line_re, line_im;
+		FLOAT32 acc_re = 0.0f, acc_im = 0.0f;
+		FLOAT32 alpha = 0.02f;
+
+		FLOAT32 tau = 0.0f;
+		FLOAT32 offset = 0.0f;
+		FLOAT32 gain = 0.5f;
+		FLOAT32 gain_acquire = 0.5f, gain_track = 0.01f;
+		int nNeighbours = 0;
+
+		T interpolate(FLOAT32 p)
+		{
+			int base = (int)std::floor(p);
+			FLOAT32 mu = p - base;
+
+			const T& xm = hist[(w + base - 1) & (nRing - 1)];
+			const T& x0 = hist[(w + base) & (nRing - 1)];
+			const T& x1 = hist[(w + base + 1) & (nRing - 1)];
+			const T& x2 = hist[(w + base + 2) & (nRing - 1)];
+
+			// Lagrange cubic in Farrow form
+			T c1 = x1 - xm * (1.0f / 3.0f) - x0 * 0.5f - x2 * (1.0f / 6.0f);
+			T c2 = (xm + x1) * 0.5f - x0;
+			T c3 = (x2 - xm) * (1.0f / 6.0f) + (x0 - x1) * 0.5f;
+
+			return ((c3 * mu + c2) * mu + c1) * mu + x0;
+		}
+
+	public:
+		void setSamplesPerSymbol(int s)
+		{
+			sps = s;
+			line_re.resize(sps); line_im.resize(sps);
+
+			for (int i = 0; i < sps; i++)
+			{
+				line_re[i] = cos(2.0 * PI * i / sps);
+				line_im[i] = -sin(2.0 * PI * i / sps);
+			}
+		}
+		void setNeighbours(int n) { nNeighbours = n; out.resize(2 * n + 1); }
+
+		// sampling point relative to the frequency peak, half a symbol for the phase points of a coherent demodulator
+		void setOffset(FLOAT32 o) { offset = o; }
+
+		// MessageIn, follow the estimate closely while searching for the training sequence and slowly within a frame
+		virtual void Message(const DecoderMessages& in)
+		{
+			switch (in)
+			{
+			case DecoderMessages::StopTraining: gain = gain_track; break;
+			case DecoderMessages::StartTraining:
+			case DecoderMessages::Reset: gain = gain_acquire; break;
+			default: break;
+			}
+		}
+
+		// Streams out, neighbours on either side of out[nNeighbours]
+		std::vector<Connection<T>> out = std::vector<Connection<T>>(1);
+
+		// Streams in
+		void Receive(const T* data, int len)
+		{
+			if (line_re.size() == 0) setSamplesPerSymbol(sps);
+
+			for (int i = 0; i < len; i++)
+			{
+				int prev = w;
+				w = (w + 1) & (nRing - 1);
+				hist[w] = data[i];
+
+				FLOAT32 f = timingSignal(data[i], hist[prev]);
+				FLOAT32 a = f * f;
+
+				acc_re += alpha * (a * line_re[phase] - acc_re);
+				acc_im += alpha * (a * line_im[phase] - acc_im);
+
+				int p_newest = phase;
+				if (++phase == sps) phase = 0;
+
+				// strobe when the samples around the latest neighbour are in, positions relative to the newest sample
+				if (--tau > -2.0f - nNeighbours) continue;
+
+				FLOAT32 peak = -std::atan2(acc_im, acc_re) * sps / (2.0f * PI) - timingDelay(data) + offset;
+				FLOAT32 e = std::fmod(peak - (p_newest + tau), (FLOAT32)sps);
+
+				if (e > sps / 2.0f) e -= sps;
+				if (e <= -sps / 2.0f) e += sps;
+
+				for (int n = -nNeighbours; n <= nNeighbours; n++)
+				{
+					T y = interpolate(tau + n);
+					out[n + nNeighbours].Send(&y, 1);
+				}
+
+				tau += sps + gain * e;
+			}
+		}
+	};
+
 	class Downsample2CIC5 : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 		CFLOAT32 h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
@@ -134,6 +255,22 @@ public:
 		void Receive(const CFLOAT32* data, int len);
 	};
 
+	// rational resampler L/M, polyphase windowed sinc with nTaps per phase
+	class ResampleComplex : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	{
+		std::vector <CFLOAT32> output;
+		std::vector <CFLOAT32> buffer;
+		std::vector <FLOAT32> taps;
+
+		int L = 1, M = 1, nTaps = 0;
+		int phase = 0;
+
+	public:
+		void setRates(int up, int down, int n);
+
+		void Receive(const CFLOAT32* data, int len);
+	};
+
 	class FilterComplex : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 		std::vector <CFLOAT32> output;
@@ -273,7 +410,42 @@ public:
 		void Receive(const CFLOAT32* data, int len);
 	};
 
-	class SquareFreqOffsetCorrection : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	// Correlates the symbol-spaced discriminator with the end of the training sequence and the start flag.
+	// Blocks are forwarded only around a detection, the previous block is held back so the full preamble
+	// reaches the demodulators. Outside bursts the samplers, demodulators and decoders are not invoked.
+	class BurstDetector : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	{
+		static const int nReference = 24;
+		static const int MaxSymbols = 600;
+
+		FLOAT32 reference[nReference];
+
+		std::vector<CFLOAT32> delay;
+		std::vector<FLOAT32> disc;
+		int idx_delay = 0, idx_disc = 0;
+
+		std::vector<CFLOAT32> held;
+		bool held_sent = true;
+		int remaining = 0;
+
+		int sps = 5;
+		FLOAT32 threshold = 0.55f;
+
+		uint64_t blocks = 0, forwarded = 0;
+
+	public:
+		BurstDetector();
+
+		void setSamplesPerSymbol(int s);
+		void setThreshold(FLOAT32 t) { threshold = t; }
+
+		uint64_t getBlocks() { return blocks; }
+		uint64_t getForwarded() { return forwarded; }
+
+		void Receive(const CFLOAT32* data, int len);
+	};
+
+	class SquareFreqOffsetCorrection : public SimpleStreamInOut<CFLOAT32, CFLOAT32>, public MessageIn<FrequencyCorrection>
 	{
 		std::vector <CFLOAT32> output;
 		std::vector <CFLOAT32> fft_data;
@@ -283,11 +455,28 @@ public:
 		int logN = 11;
 		int count = 0;
 		int window = 750;
+		int sample_rate = 48000;
+
+		FLOAT32 fz = 0.0f;
+
+		// decision directed tracking: skip the FFT for nHold blocks after a confirmed frame
+		FLOAT32 fz_track = 0.0f;
+		int hold = 0;
+		int nHold = 0;
 
 		void correctFrequency();
 
 	public:
 		void setN(int,int);
+		void setSampleRate(int r) { sample_rate = r; }
+		void setTracking(int n) { nHold = n; }
+
+		// carrier offset (Hz) currently corrected for
+		FLOAT32 getOffset() { return -fz * sample_rate / (2.0f * N); }
+
 		void Receive(const CFLOAT32* data, int len);
+
+		// MessageIn
+		virtual void Message(const FrequencyCorrection& in);
 	};
 }
@@ -23,6 +23,7 @@ SOFTWARE.
 #include <chrono>
 #include <cassert>
 #include <complex>
+#include <algorithm>
 
 #include "Demod.h"
 #include "DSP.h"
@@ -30,16 +31,72 @@ SOFTWARE.
 namespace DSP
 {
 
+	// minimax polynomials for atan(a) on [0,1], max abs error 6.1e-4 and 1.8e-6 rad (measured in float)
+	static inline FLOAT32 atanLow(FLOAT32 a)
+	{
+		FLOAT32 s = a * a;
+		return a * (0.995357955f + s * (-0.288690238f + s * 0.079339041f));
+	}
+
+	static inline FLOAT32 atanHigh(FLOAT32 a)
+	{
+		FLOAT32 s = a * a;
+		return a * (0.999977219f + s * (-0.332622828f + s * (0.193540376f + s * (-0.116426482f + s * (0.052647351f + s * -0.011719136f)))));
+	}
+
+	// branch free octant reduction so the compiler can vectorize the calling loop
+	template<FLOAT32 (*ATAN)(FLOAT32)>
+	static inline FLOAT32 fastAtan2(FLOAT32 y, FLOAT32 x)
+	{
+		FLOAT32 ax = std::abs(x), ay = std::abs(y);
+		FLOAT32 mx = ax > ay ? ax : ay;
+		FLOAT32 mn = ax > ay ? ay : ax;
+
+		FLOAT32 r = ATAN(mn / (mx + 1e-30f));
+
+		r = ay > ax ? (FLOAT32)(PI / 2.0) - r : r;
+		r = x < 0 ? (FLOAT32)PI - r : r;
+		return y < 0 ? -r : r;
+	}
+
+	template<FLOAT32 (*ATAN)(FLOAT32)>
+	static void discriminator(const CFLOAT32* data, CFLOAT32 prev, FLOAT32* out, int len, FLOAT32 shift)
+	{
+		const FLOAT32 scale = 1.0f / PI;
+
+		out[0] = (fastAtan2<ATAN>(data[0].imag() * prev.real() - data[0].real() * prev.imag(), data[0].real() * prev.real() + data[0].imag() * prev.imag()) + shift) * scale;
+
+		for (int i = 1; i < len; i++)
+		{
+			FLOAT32 re = data[i].real() * data[i - 1].real() + data[i].imag() * data[i - 1].imag();
+			FLOAT32 im = data[i].imag() * data[i - 1].real() - data[i].real() * data[i - 1].imag();
+
+			out[i] = (fastAtan2<ATAN>(im, re) + shift) * scale;
+		}
+	}
+
 	void FMDemodulation::Receive(const CFLOAT32* data, int len)
 	{
+		if (len == 0) return;
 		if (output.size() < len) output.resize(len);
 
-		for (int i = 0; i < len; i++)
+		switch (precision)
 		{
-			auto p = data[i] * std::conj(prev);
-			output[i] = (atan2f(p.imag(), p.real()) + DC_shift) / PI;
-			prev = data[i];
+		case FMPrecision::HIGH:
+			discriminator<atanHigh>(data, prev, output.data(), len, DC_shift);
+			break;
+		case FMPrecision::LOW:
+			discriminator<atanLow>(data, prev, output.data(), len, DC_shift);
+			break;
+		default:
+			for (int i = 0; i < len; i++)
+			{
+				auto p = data[i] * std::conj(i ? data[i - 1] : prev);
+				output[i] = (atan2f(p.imag(), p.real()) + DC_shift) / PI;
+			}
+			break;
 		}
+		prev = data[len - 1];
 
 		sendOut(output.data(), len);
 	}
@@ -47,83 +104,314 @@ namespace DSP
 	void CoherentDemodulation::setPhases()
 	{
 		int np2 = nPhases / 2;
-		phase.resize(np2);
 
+		// lane j and nPhases - 1 - j project on the conjugate angles
 		for (int i = 0; i < np2; i++)
 		{
 			float alpha = PI / 2.0 / np2 * i + PI / 2.0 / (2.0 * np2);
-			phase[i] = std::polar(1.0f, alpha);
+
+			phase_re[i] = phase_re[nPhases - 1 - i] = cos(alpha);
+			phase_im[i] = sin(alpha);
+			phase_im[nPhases - 1 - i] = -sin(alpha);
+		}
+		initialized = true;
+	}
+
+	void CoherentDemodulation::derotate(const CFLOAT32& sample, FLOAT32& re, FLOAT32& im)
+	{
+		//  multiply samples with (1j) ** i, to get all points on the same line 
+		switch (rot)
+		{
+		case 0: re = sample.real(); im = sample.imag(); break;
+		case 1: im = sample.real(); re = -sample.imag(); break;
+		case 2: re = -sample.real(); im = -sample.imag(); break;
+		case 3: im = -sample.real(); re = sample.imag(); break;
+		}
+
+		rot = (rot + 1) & 3;
+
+		hist_re[last] = re;
+		hist_im[last] = im;
+	}
+
+	void CoherentDemodulation::searchPhase(const CFLOAT32& sample, FLOAT32& re, FLOAT32& im)
+	{
+		derotate(sample, re, im);
+
+		// Determining the phase is approached as a linear classification problem, all hypotheses in one pass
+		FLOAT32 t[nPhases], abs_t[nPhases];
+
+		for (int j = 0; j < nPhases; j++) t[j] = re * phase_re[j] + im * phase_im[j];
+		for (int j = 0; j < nPhases; j++) abs_t[j] = std::abs(t[j]);
+		for (int j = 0; j < nPhases; j++) memory[last][j] = t[j];
+
+		// minimum over the last nHistory values: suffix of the previous block and prefix of the current
+		if (last == 0)
+		{
+			for (int j = 0; j < nPhases; j++) prefix[j] = abs_t[j];
+		}
+		else
+		{
+			for (int j = 0; j < nPhases; j++) prefix[j] = abs_t[j] < prefix[j] ? abs_t[j] : prefix[j];
+		}
+
+		if (last == nHistory - 1)
+		{
+			for (int j = 0; j < nPhases; j++) min_abs[j] = prefix[j];
+			for (int j = 0; j < nPhases; j++) suffix[nHistory - 1][j] = abs_t[j];
+
+			// block complete, amortized one comparison per symbol
+			for (int l = nHistory - 2; l >= 0; l--)
+				for (int j = 0; j < nPhases; j++)
+					suffix[l][j] = std::abs(memory[l][j]) < suffix[l + 1][j] ? std::abs(memory[l][j]) : suffix[l + 1][j];
+		}
+		else
+		{
+			for (int j = 0; j < nPhases; j++) min_abs[j] = suffix[last + 1][j] < prefix[j] ? suffix[last + 1][j] : prefix[j];
+		}
+
+		update = (update + 1) % nUpdate;
+		if (update == 0)
+		{
+			FLOAT32 max_val = 0;
+			int prev_max = max_idx;
+
+			// local minmax search
+			for (int p = nPhases - nSearch; p <= nPhases + nSearch; p++)
+			{
+				int j = (p + prev_max) % nPhases;
+
+				if (min_abs[j] > max_val)
+				{
+					max_val = min_abs[j];
+					max_idx = j;
+				}
+			}
+		}
+	}
+
+	// the decoder has seen the training sequence: fix the phase from the symbols in the history
+	void CoherentDemodulation::startTracking()
+	{
+		FLOAT32 sum_re = 0.0f, sum_im = 0.0f;
+
+		for (int l = 0; l < nHistory; l++)
+		{
+			FLOAT32 s = memory[l][max_idx] > 0 ? 1.0f : -1.0f;
+
+			sum_re += s * hist_re[l];
+			sum_im += s * hist_im[l];
+		}
+
+		FLOAT32 norm = std::sqrt(sum_re * sum_re + sum_im * sum_im);
+		if (norm == 0.0f) return;
+
+		track_re = sum_re / norm;
+		track_im = sum_im / norm;
+
+		int prev = (last + nHistory - 1) & (nHistory - 1);
+		FLOAT32 t = hist_re[prev] * track_re + hist_im[prev] * track_im;
+		track_bit = t > 0;
+		track_abs = std::abs(t);
+
+		tracking = true;
+	}
+
+	// projections and sliding minimum of all hypotheses from the stored samples
+	void CoherentDemodulation::rebuildHistory()
+	{
+		for (int l = 0; l < nHistory; l++)
+			for (int j = 0; j < nPhases; j++)
+				memory[l][j] = hist_re[l] * phase_re[j] + hist_im[l] * phase_im[j];
+
+		for (int j = 0; j < nPhases; j++) suffix[nHistory - 1][j] = std::abs(memory[nHistory - 1][j]);
+
+		for (int l = nHistory - 2; l >= 0; l--)
+			for (int j = 0; j < nPhases; j++)
+				suffix[l][j] = std::abs(memory[l][j]) < suffix[l + 1][j] ? std::abs(memory[l][j]) : suffix[l + 1][j];
+
+		for (int j = 0; j < nPhases; j++) prefix[j] = last > 0 ? std::abs(memory[0][j]) : 0.0f;
+
+		for (int l = 1; l < last; l++)
+			for (int j = 0; j < nPhases; j++)
+				prefix[j] = std::abs(memory[l][j]) < prefix[j] ? std::abs(memory[l][j]) : prefix[j];
+	}
+
+	// back to the full search from the tracked phase
+	void CoherentDemodulation::stopTracking()
+	{
+		tracking = false;
+
+		rebuildHistory();
+
+		// hypotheses 8..15,0..7 cover (-pi/2, pi/2) in steps of pi/nPhases, the line has no direction
+		FLOAT32 angle = atan2(track_im, track_re);
+
+		if (angle > PI / 2) angle -= PI;
+		if (angle <= -PI / 2) angle += PI;
+
+		int k = (int)((angle + PI / 2) / (PI / nPhases));
+		max_idx = (std::min(k, nPhases - 1) + nPhases / 2) & (nPhases - 1);
+	}
+
+	void CoherentDemodulation::Message(const DecoderMessages& in)
+	{
+		switch (in)
+		{
+		case DecoderMessages::StopTraining:
+			if (tracking_enabled && !tracking) startTracking();
+			break;
+		case DecoderMessages::StartTraining:
+		case DecoderMessages::Reset:
+			if (tracking) stopTracking();
+			else if (suspended) rebuildHistory();
+			suspended = false;
+			break;
+		case DecoderMessages::Suspend:
+			suspended = true;
+			break;
 		}
 	}
 
 	void CoherentDemodulation::Receive(const CFLOAT32* data, int len)
 	{
-		if (phase.size() == 0) setPhases();
+		if (!initialized) setPhases();
 
 		for (int i = 0; i < len; i++)
 		{
 			FLOAT32 re, im;
 
-			//  multiply samples with (1j) ** i, to get all points on the same line 
-			switch (rot)
+			if (suspended)
 			{
-			case 0: re = data[i].real(); im = data[i].imag(); break;
-			case 1: im = data[i].real(); re = -data[i].imag(); break;
-			case 2: re = -data[i].real(); im = -data[i].imag(); break;
-			case 3: im = -data[i].real(); re = data[i].imag(); break;
+				derotate(data[i], re, im);
+				nextSymbol();
+				continue;
 			}
 
-			rot = (rot + 1) & 3;
-
-			// Determining the phase is approached as a linear classification problem. 
-			for (int j = 0; j < nPhases / 2; j++)
+			if (tracking)
 			{
-				FLOAT32 a = re * phase[j].real();
-				FLOAT32 b = im * phase[j].imag();
-				FLOAT32 t;
+				derotate(data[i], re, im);
 
-				bits[j] <<= 1;
-				bits[nPhases - 1 - j] <<= 1;
+				// single hypothesis, the quadrature component drives the phase
+				FLOAT32 t = re * track_re + im * track_im;
+				FLOAT32 q = im * track_re - re * track_im;
 
-				t = a + b;
-				bits[j] |= ((t) > 0) & 1;
-				memory[j][last] = std::abs(t);
+				bool b1 = t > 0;
+				FLOAT32 err = track_gain * (b1 ? q : -q) / (std::abs(t) + std::abs(q) + 1e-12f);
 
-				t = a - b;
-				bits[nPhases - 1 - j] |= ((t) > 0) & 1;
-				memory[nPhases - 1 - j][last] = std::abs(t);
+				FLOAT32 nr = track_re - err * track_im;
+				FLOAT32 ni = track_im + err * track_re;
+				FLOAT32 g = 1.5f - 0.5f * (nr * nr + ni * ni);
+
+				track_re = nr * g;
+				track_im = ni * g;
+
+				FLOAT32 r = std::min(std::abs(t), track_abs);
+				FLOAT32 b = b1 ^ track_bit ? r : -r;
+				track_bit = b1;
+				track_abs = std::abs(t);
+
+				nextSymbol();
+
+				sendOut(&b, 1);
+				continue;
 			}
-			last = (last + 1) % nHistory;
 
+			searchPhase(data[i], re, im);
 
-			update = (update + 1) % nUpdate;
-			if (update == 0)
-			{
-				FLOAT32 max_val = 0;
-				int prev_max = max_idx;
+			// determine the bit
+			int prev = (last + nHistory - 1) & (nHistory - 1);
 
-				// local minmax search
-				for (int p = nPhases - nSearch; p <= nPhases + nSearch; p++)
+			bool b2 = memory[prev][max_idx] > 0;
+			bool b1 = memory[last][max_idx] > 0;
+
+			// soft output, the magnitude is the reliability of the weakest symbol
+			FLOAT32 r = std::min(std::abs(memory[prev][max_idx]), std::abs(memory[last][max_idx]));
+			FLOAT32 b = b1 ^ b2 ? r : -r;
+
+			nextSymbol();
+
+			sendOut(&b, 1);
+		}
+	}
+
+	void ViterbiDemodulation::Receive(const CFLOAT32* data, int len)
+	{
+		if (!initialized) setPhases();
+
+		for (int i = 0; i < len; i++)
+		{
+			FLOAT32 re, im;
+
+			searchPhase(data[i], re, im);
+
+			// hypotheses 7 and 8 are neighbours on opposite ends of the line, keep the constellation continuous
+			if (((max_idx ^ prev_idx) & 8) && max_idx >= 4 && max_idx < 12) polarity = -polarity;
+			prev_idx = max_idx;
+
+			FLOAT32 u_re = polarity * (re * phase_re[max_idx] + im * phase_im[max_idx]);
+			FLOAT32 u_im = polarity * (im * phase_re[max_idx] - re * phase_im[max_idx]);
+
+			ring_re[ring] = u_re;
+
+			// add-compare-select, state = (b[k-1], b[k]), branch extends with b[k+1]
+			FLOAT32 bm[nStates][2], new_metric[nStates];
+			uint64_t new_path[nStates];
+
+			for (int s = 0; s < nStates; s++)
+			{
+				for (int x = 0; x < 2; x++)
 				{
-					int j = (p + prev_max) % nPhases;
-					FLOAT32 min_abs = memory[j][0];
+					int from = (x << 1) | (s >> 1);
 
-					for (int l = 1; l < nHistory; l++)
-						min_abs = memory[j][l] < min_abs ? memory[j][l] : min_abs;
+					FLOAT32 b_prev = (from & 2) ? 1.0f : -1.0f;
+					FLOAT32 b_curr = (from & 1) ? 1.0f : -1.0f;
+					FLOAT32 b_next = (s & 1) ? 1.0f : -1.0f;
 
-					if (min_abs > max_val)
-					{
-						max_val = min_abs;
-						max_idx = j;
-					}
+					FLOAT32 er = u_re - h0 * b_curr;
+					FLOAT32 ei = u_im - cm * b_prev - cp * b_next;
+
+					bm[s][x] = metric[from] + er * er + ei * ei;
 				}
 			}
 
-			// determine the bit
-			bool b2 = (bits[max_idx] & 2) >> 1;
-			bool b1 = bits[max_idx] & 1;
+			for (int s = 0; s < nStates; s++)
+			{
+				int sel = bm[s][1] < bm[s][0] ? 1 : 0;
+				int from = (sel << 1) | (s >> 1);
+
+				new_metric[s] = bm[s][sel];
+				new_path[s] = (path[from] << 1) | (s & 1);
+			}
 
-			FLOAT32 b = b1 ^ b2 ? 1.0f : -1.0f;
+			int best = 0;
+			for (int s = 0; s < nStates; s++)
+			{
+				metric[s] = new_metric[s] - new_metric[0];
+				path[s] = new_path[s];
+				if (metric[s] < metric[best]) best = s;
+			}
+
+			// decisions nDelay symbols back are final, use them to update the channel taps
+			uint64_t p = path[best];
+
+			FLOAT32 b_curr = (p >> nDelay) & 1 ? 1.0f : -1.0f;
+			FLOAT32 b_prev = (p >> (nDelay + 1)) & 1 ? 1.0f : -1.0f;
+
+			int m = (ring - nDelay + 1) & (nRing - 1);
+
+			FLOAT32 er = ring_re[m] - h0 * b_curr;
+
+			h0 += mu * er * b_curr;
+			// quadrature taps follow the GMSK pulse shape, adapting them freely drifts on noise between bursts
+			cm = isi * h0;
+			cp = -cm;
+
+			ring = (ring + 1) & (nRing - 1);
+
+			FLOAT32 b = b_curr != b_prev ? 1.0f : -1.0f;
+
+			nextSymbol();
 
 			sendOut(&b, 1);
 		}
@@ -141,8 +429,34 @@ namespace DSP
 		}
 	}
 
+	// StopTraining marks the start flag, Reset from our own decoder a frame that passed the CRC
 	void ChallengerDemodulation::Message(const DecoderMessages& in)
 	{
+		switch (in)
+		{
+		case DecoderMessages::StopTraining:
+			dd_active = true;
+			dd_sum = 0.0f;
+			dd_count = 0;
+			break;
+		case DecoderMessages::Reset:
+			if (dd_active && dd_count > 0)
+			{
+				FrequencyCorrection fc = { (float)(std::arg(dd_sum) * 9600.0 / (2.0 * PI)), dd_count };
+				FrequencyMessage.Send(fc);
+			}
+			dd_active = false;
+			suspended = false;
+			break;
+		case DecoderMessages::StartTraining:
+			dd_active = false;
+			suspended = false;
+			break;
+		case DecoderMessages::Suspend:
+			dd_active = false;
+			suspended = true;
+			break;
+		}
 	}
 
 	void ChallengerDemodulation::Receive(const CFLOAT32* data, int len)
@@ -153,6 +467,12 @@ namespace DSP
 		{
 			FLOAT32 re, im;
 
+			if (suspended)
+			{
+				rot = (rot + 1) & 3;
+				continue;
+			}
+
 			//  multiply samples with (1j) ** i, to get all points on the same line 
 			switch (rot)
 			{
@@ -207,11 +527,23 @@ namespace DSP
 				}
 			}
 
-			// determine the bit
+			// determine the bit, soft output with the reliability of the weakest symbol
 			bool b2 = (bits[max_idx] & 2) >> 1;
 			bool b1 = bits[max_idx] & 1;
 
-			FLOAT32 b = b1 ^ b2 ? 1.0f : -1.0f;
+			int cur = (last + nHistory - 1) % nHistory, prev = (last + nHistory - 2) % nHistory;
+			FLOAT32 r = std::min(memory[max_idx][cur], memory[max_idx][prev]);
+			FLOAT32 b = b1 ^ b2 ? r : -r;
+
+			// remove the decided symbol, phase progression is the residual frequency
+			CFLOAT32 z = b1 ? CFLOAT32(re, im) : CFLOAT32(-re, -im);
+
+			if (dd_active)
+			{
+				dd_sum += z * std::conj(dd_prev);
+				dd_count++;
+			}
+			dd_prev = z;
 
 			sendOut(&b, 1);
 		}
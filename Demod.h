@@ -28,35 +28,105 @@ SOFTWARE.
 
 namespace DSP
 {
+	// atan2 used in the FM discriminator: libm, polynomial with max error 1.8e-6 rad or 6.1e-4 rad
+	enum class FMPrecision { EXACT, HIGH, LOW };
+
 	class FMDemodulation : public SimpleStreamInOut<CFLOAT32, FLOAT32>
 	{
 		std::vector <FLOAT32> output;
 		CFLOAT32 prev = 0.0;
 		float DC_shift = 0.0;
 
+		FMPrecision precision = FMPrecision::HIGH;
+
 	public:
 
 		void Receive(const CFLOAT32* data, int len);
 		void setDCShift(float s) { DC_shift = s; }
+		void setPrecision(FMPrecision p) { precision = p; }
 	};
 
-	class CoherentDemodulation : public SimpleStreamInOut<CFLOAT32, FLOAT32>
+	class CoherentDemodulation : public SimpleStreamInOut<CFLOAT32, FLOAT32>, public MessageIn<DecoderMessages>
 	{
+	protected:
+
 		static const int nHistory = 8;
 		static const int nPhases = 16;
 		static const int nSearch = 2;
 		static const int nUpdate = 1;
 
-		std::vector <CFLOAT32> phase;
-		FLOAT32 memory[nPhases][nHistory];
-		char bits[nPhases];
+		// structure of arrays, one lane per phase hypothesis, the sign of the projection is the bit
+		FLOAT32 phase_re[nPhases] = { 0 }, phase_im[nPhases] = { 0 };
+		FLOAT32 memory[nHistory][nPhases] = { { 0 } };
+
+		// sliding minimum of |memory| over nHistory symbols (van Herk/Gil-Werman), last is the position in the block
+		FLOAT32 suffix[nHistory][nPhases] = { { 0 } };
+		FLOAT32 prefix[nPhases] = { 0 };
+		FLOAT32 min_abs[nPhases] = { 0 };
+
+		bool initialized = false;
 
 		int max_idx = 0;
 		int update = 0;
 		int rot = 0;
 		int last = 0;
 
+		// derotated samples of the last nHistory symbols
+		FLOAT32 hist_re[nHistory] = { 0 }, hist_im[nHistory] = { 0 };
+
+		// per burst phase estimate from the training sequence, tracked with a decision directed loop
+		bool tracking_enabled = false;
+		bool tracking = false;
+		FLOAT32 track_re = 1.0f, track_im = 0.0f;
+		FLOAT32 track_gain = 0.1f;
+		bool track_bit = false;
+		FLOAT32 track_abs = 0.0f;
+
+		// the decoder lost to a better bucket, only keep the derotation and history going
+		bool suspended = false;
+
 		void setPhases();
+		void derotate(const CFLOAT32& sample, FLOAT32& re, FLOAT32& im);
+
+		// derotate the sample, evaluate all hypotheses and select max_idx, the history is advanced by the caller
+		void searchPhase(const CFLOAT32& sample, FLOAT32& re, FLOAT32& im);
+		void nextSymbol() { last = (last + 1) & (nHistory - 1); }
+
+		void rebuildHistory();
+		void startTracking();
+		void stopTracking();
+
+	public:
+
+		void setPhaseTracking(bool b) { tracking_enabled = b; }
+
+		// MessageIn
+		virtual void Message(const DecoderMessages& in);
+		void Receive(const CFLOAT32* data, int len);
+	};
+
+	// Maximum likelihood sequence estimation on top of the coherent phase search. After derotation the GMSK (BT = 0.4)
+	// symbol is on the in-phase axis and its neighbours leak into the quadrature component. The gain is learned
+	// from the decisions (LMS) and a 4-state Viterbi with register exchange decides with a fixed delay.
+	class ViterbiDemodulation : public CoherentDemodulation
+	{
+		static const int nStates = 4;
+		static const int nDelay = 16;
+		static const int nRing = 32;
+
+		FLOAT32 metric[nStates] = { 0 };
+		uint64_t path[nStates] = { 0 };
+
+		// observation u = h0 b[k] + j (cm b[k-1] + cp b[k+1]), with cm = -cp = isi h0
+		FLOAT32 h0 = 1e-3f, cm = 0.0f, cp = 0.0f;
+		FLOAT32 isi = 0.1f;
+		FLOAT32 mu = 0.05f;
+
+		FLOAT32 ring_re[nRing] = { 0 };
+		int ring = 0;
+
+		int polarity = 1;
+		int prev_idx = 0;
 
 	public:
 
@@ -79,6 +149,14 @@ namespace DSP
 		int rot = 0;
 		int last = 0;
 
+		// decision directed frequency estimate over the current frame
+		CFLOAT32 dd_prev = 0.0f;
+		CFLOAT32 dd_sum = 0.0f;
+		int dd_count = 0;
+		bool dd_active = false;
+
+		bool suspended = false;
+
 		void setPhases();
 
 	public:
@@ -86,5 +164,8 @@ namespace DSP
 		// MessageIn
 		virtual void Message(const DecoderMessages& in);
 		void Receive(const CFLOAT32* data, int len);
+
+		// MessageOut
+		MessageHub<FrequencyCorrection> FrequencyMessage;
 	};
 }
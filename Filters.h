@@ -23,6 +23,7 @@ SOFTWARE.
 #pragma once
 
 #include <vector>
+#include <cmath>
 #include "Common.h"
 
 namespace Filters
@@ -47,5 +48,19 @@ namespace Filters
        		1.30411453e-02, 2.52892989e-03, 3.40605309e-04, 3.18610148e-05,
        		2.06995719e-06
         };
-}
 
+	// the Gaussian of Coherent for another number of samples per symbol
+	inline std::vector<FLOAT32> CoherentForSamplesPerSymbol(int sps)
+	{
+		const double a = 0.1822 * 25.0 / (sps * sps);
+		int half = (8 * sps + 2) / 5;
+
+		std::vector<FLOAT32> taps(2 * half + 1);
+		double sum = 0.0;
+
+		for (int i = -half; i <= half; i++) sum += exp(-a * i * i);
+		for (int i = -half; i <= half; i++) taps[i + half] = (FLOAT32)(exp(-a * i * i) / sum);
+
+		return taps;
+	}
+}
@@ -20,23 +20,435 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <cerrno>
+#include <cmath>
 #include <cstring>
+#include <ctime>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#endif
 
 #include "IO.h"
 
 namespace IO
 {
+	// lines are collected in a buffer, written when it is nearly full and on flush
+	void DumpScreen::Receive(const NMEA* data, int len)
+	{
+		const int MaxLine = NMEA::MaxLength + 256;
+
+		for (int i = 0; i < len; i++)
+			for (int j = 0; j < data[i].nSentences; j++)
+			{
+				const NMEA& m = data[i];
+
+				if (n > BufferSize - MaxLine) flush();
+
+				memcpy(buffer + n, m.sentence[j], m.length[j]);
+				n += m.length[j];
+
+				n += snprintf(buffer + n, BufferSize - n, " ( MSG: %d, REPEAT: %d, MMSI: %u%s", m.msg, m.repeat, m.mmsi, m.corrected ? ", CORRECTED" : "");
+
+				if (metadata)
+					n += snprintf(buffer + n, BufferSize - n, ", START: %llu, OFFSET: %d Hz, SIGNAL: %d dB, NOISE: %d dB, LANE: %d, MODEL: %d", (unsigned long long)m.start,
+						(int)m.offset, PowerToDB(m.signal), PowerToDB(m.noise), m.lane, m.model);
+
+				buffer[n++] = ')';
+				buffer[n++] = '\n';
+			}
+	}
+
+	void DumpScreen::ReceiveText(const char* data, int len)
+	{
+		if (n + len > BufferSize) flush();
+
+		if (len > BufferSize)
+			std::cout.write(data, len);
+		else
+		{
+			memcpy(buffer + n, data, len);
+			n += len;
+		}
+	}
+
+	void DumpScreen::flush()
+	{
+		if (n == 0) return;
+
+		std::cout.write(buffer, n);
+		std::cout.flush();
+		n = 0;
+	}
+
+	void AsyncOutput::start()
+	{
+		queue.resize(QueueSize);
+
+		running = true;
+		output_thread = std::thread(&AsyncOutput::run, this);
+	}
+
+	void AsyncOutput::stop()
+	{
+		if (!running) return;
+
+		running = false;
+		if (output_thread.joinable()) output_thread.join();
+	}
+
+	void AsyncOutput::Receive(const NMEA* data, int len)
+	{
+		if (!running)
+		{
+			sendOut(data, len);
+			return;
+		}
+
+		uint64_t h = head.load(std::memory_order_relaxed);
+
+		for (int i = 0; i < len; i++)
+		{
+			while (h - tail.load(std::memory_order_acquire) == QueueSize)
+			{
+				if (!wait) break;
+				std::this_thread::sleep_for(milliseconds(1));
+			}
+
+			if (h - tail.load(std::memory_order_acquire) == QueueSize)
+			{
+				dropped++;
+				continue;
+			}
+
+			queue[h & (QueueSize - 1)] = data[i];
+			head.store(++h, std::memory_order_release);
+		}
+	}
+
+	// frames are passed on in place, contiguous runs of up to MaxBatch, before the slots are released
+	void AsyncOutput::run()
+	{
+		while (true)
+		{
+			uint64_t t = tail.load(std::memory_order_relaxed);
+			uint64_t h = head.load(std::memory_order_acquire);
+
+			if (t == h)
+			{
+				for (auto f : flushables) f->flush();
+
+				if (!running && head.load(std::memory_order_acquire) == t) break;
+
+				std::this_thread::sleep_for(milliseconds(10));
+				continue;
+			}
+
+			int k = (int)(t & (QueueSize - 1));
+			int len = (int)std::min(h - t, (uint64_t)std::min(MaxBatch, QueueSize - k));
+
+			sendOut(&queue[k], len);
+			tail.store(t + len, std::memory_order_release);
+		}
+	}
+
+	// FileWriter
+
+	void FileWriter::openFile(std::string fn)
+	{
+		filename = fn;
+
+		storage.resize((size_t)nBuffers * BufferSize + Alignment);
+		char* base = storage.data() + (Alignment - (uintptr_t)storage.data() % Alignment) % Alignment;
+
+		for (int i = 0; i < nBuffers; i++)
+		{
+			buffers.push_back(base + (size_t)i * BufferSize);
+			free_buffers.push_back(i);
+		}
+		length.resize(nBuffers, 0);
+
+		openNext();
+		if (!file) throw "Cannot open output file.";
+
+		file_opened = steady_clock::now();
+		running = true;
+		writer_thread = std::thread(&FileWriter::run, this);
+	}
+
+	void FileWriter::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (!running) return;
+
+			if (current >= 0) handOff(false);
+			running = false;
+		}
+		cv_jobs.notify_one();
+
+		if (writer_thread.joinable()) writer_thread.join();
+	}
+
+	// room for len bytes in the current and the free buffers, only the producer takes buffers so the room stays
+	bool FileWriter::acquire(std::unique_lock<std::mutex>& lock, int len)
+	{
+		int room = current >= 0 ? BufferSize - length[current] : 0;
+		if (room >= len) return true;
+
+		int needed = (len - room + BufferSize - 1) / BufferSize;
+		if (needed > nBuffers) return false;
+
+		if (wait) cv_free.wait(lock, [&] { return (int)free_buffers.size() >= needed; });
+
+		return (int)free_buffers.size() >= needed;
+	}
+
+	// queues the current buffer, or only a rotation if there is none
+	void FileWriter::handOff(bool rotate)
+	{
+		jobs.push({ current, rotate });
+		current = -1;
+		cv_jobs.notify_one();
+	}
+
+	void FileWriter::startRotation(steady_clock::time_point now)
+	{
+		handOff(true);
+		file_bytes = 0;
+		file_opened = now;
+	}
+
+	void FileWriter::checkTime(steady_clock::time_point now)
+	{
+		if (rotate_time && file_bytes > 0 && now - file_opened >= seconds(rotate_time))
+			startRotation(now);
+		else if (current >= 0 && now - buffer_started >= seconds(FlushInterval))
+			handOff(false);
+	}
+
+	void FileWriter::write(const char* data, int len)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		if (!running) return;
+
+		steady_clock::time_point now = steady_clock::now();
+
+		if (rotate_size && file_bytes > 0 && file_bytes + len > rotate_size)
+			startRotation(now);
+		else
+			checkTime(now);
+
+		if (!acquire(lock, len))
+		{
+			dropped += len;
+			return;
+		}
+
+		while (len > 0)
+		{
+			if (current < 0)
+			{
+				current = free_buffers.back();
+				free_buffers.pop_back();
+				buffer_started = now;
+			}
+
+			int m = std::min(len, BufferSize - length[current]);
+			memcpy(buffers[current] + length[current], data, m);
+			length[current] += m; file_bytes += m;
+			data += m; len -= m;
+
+			if (length[current] == BufferSize) handOff(false);
+		}
+	}
+
+	void FileWriter::openNext()
+	{
+		std::string name = filename;
+
+		if (rotate_size || rotate_time)
+		{
+			char suffix[32];
+			time_t t = time(NULL);
+
+			int n = strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", gmtime(&t));
+			snprintf(suffix + n, sizeof(suffix) - n, ".%03d", sequence++ % 1000);
+			name += suffix;
+		}
+
+		file = fopen(name.c_str(), "ab");
+		if (file) setvbuf(file, NULL, _IONBF, 0);
+
+		last_sync = steady_clock::now();
+	}
+
+	void FileWriter::sync()
+	{
+		fflush(file);
+#ifndef WIN32
+		fsync(fileno(file));
+#endif
+		last_sync = steady_clock::now();
+		dirty = false;
+	}
+
+	void FileWriter::closeFile()
+	{
+		if (!file) return;
+
+		sync();
+		fclose(file);
+		file = NULL;
+	}
+
+	void FileWriter::writeBuffer(int buffer)
+	{
+		if (!file) return;
+
+		if (fwrite(buffers[buffer], 1, length[buffer], file) != (size_t)length[buffer])
+		{
+			std::cerr << "Write error on " << filename << ", output stopped." << std::endl;
+			closeFile();
+			return;
+		}
+		dirty = true;
+	}
+
+	void FileWriter::run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (running || !jobs.empty())
+		{
+			if (jobs.empty())
+			{
+				cv_jobs.wait_for(lock, seconds(FlushInterval));
+				if (running) checkTime(steady_clock::now());
+			}
+			else
+			{
+				Job job = jobs.front();
+				jobs.pop();
+				lock.unlock();
+
+				if (job.buffer >= 0) writeBuffer(job.buffer);
+
+				if (job.rotate)
+				{
+					closeFile();
+					openNext();
+
+					if (!file) std::cerr << "Cannot open next file for " << filename << ", output stopped." << std::endl;
+				}
+
+				lock.lock();
+
+				if (job.buffer >= 0)
+				{
+					length[job.buffer] = 0;
+					free_buffers.push_back(job.buffer);
+					cv_free.notify_one();
+				}
+			}
+
+			if (dirty && steady_clock::now() - last_sync >= seconds(SyncInterval))
+			{
+				lock.unlock();
+				sync();
+				lock.lock();
+			}
+		}
+
+		lock.unlock();
+		closeFile();
+	}
+
 	void UDP::Receive(const NMEA* data, int len)
 	{
-		for(int i = 0; i < len; i++)
-			for(auto s : data[i].sentence)
-				sendto(sock, (s+"\r\n").c_str(), s.length()+2, 0, address->ai_addr, address->ai_addrlen);
+		for (int i = 0; i < len; i++)
+			for (int j = 0; j < data[i].nSentences; j++)
+			{
+				if (nBatch == MaxBatch) flush();
+
+				length[nBatch] = data[i].length[j] + 2;
+				memcpy(batch[nBatch++], data[i].sentence[j], data[i].length[j] + 2);
+			}
+	}
+
+	// lines that do not fit in a datagram slot are dropped
+	void UDP::ReceiveText(const char* data, int len)
+	{
+		if (len > MaxLength) return;
+		if (nBatch == MaxBatch) flush();
+
+		length[nBatch] = len;
+		memcpy(batch[nBatch++], data, len);
+	}
+
+	void UDP::flush()
+	{
+		if (nBatch == 0) return;
+
+		for (auto& d : destinations)
+		{
+#ifdef __linux__
+			for (int i = 0; i < nBatch; i++)
+			{
+				iov[i].iov_base = batch[i];
+				iov[i].iov_len = length[i];
+
+				memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+				msgs[i].msg_hdr.msg_name = d.address->ai_addr;
+				msgs[i].msg_hdr.msg_namelen = d.address->ai_addrlen;
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			// a datagram that cannot be sent is dropped, as with sendto
+			for (int sent = 0; sent < nBatch; )
+			{
+				int r = sendmmsg(d.sock, msgs + sent, nBatch - sent, 0);
+				sent += r > 0 ? r : 1;
+			}
+#else
+			for (int i = 0; i < nBatch; i++)
+				sendto(d.sock, batch[i], length[i], 0, d.address->ai_addr, d.address->ai_addrlen);
+#endif
+		}
+
+		nBatch = 0;
+	}
+
+	UDP::~UDP()
+	{
+		flush();
+
+		for (auto& d : destinations)
+		{
+#ifdef WIN32
+			closesocket(d.sock);
+#else
+			close(d.sock);
+#endif
+			freeaddrinfo(d.address);
+		}
+
+		if (!destinations.empty()) closeWSA();
 	}
 
 	void UDP::startWSA()
 	{
 #ifdef WIN32
-		address = NULL;
 		int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
 		if (iResult != 0)
 		{
@@ -64,8 +476,9 @@ namespace IO
 		h.ai_flags = AI_ADDRCONFIG;
 #endif
 
-		startWSA();
+		if (destinations.empty()) startWSA();
 
+		struct addrinfo* address = NULL;
 		int code = getaddrinfo(host.c_str(), portname.c_str(), &h, &address);
 
 		if(code != 0 || address == NULL)
@@ -74,11 +487,429 @@ namespace IO
 			return;
 		}
 
-		sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		int sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
 
 		if (sock == -1)
 		{
+			freeaddrinfo(address);
 			throw "Error creating socket for UDP.";
 		}
+
+		destinations.push_back({ sock, address });
 	}
+
+	// BinaryLog
+
+	static int BloomBit(uint32_t mmsi, int k)
+	{
+		uint64_t h = ((uint64_t)mmsi + 1) * 0x9E3779B97F4A7C15ULL;
+		return (h >> (53 - 11 * k)) & (LogBlock::BloomWords * 64 - 1);
+	}
+
+	void LogBlock::addMMSI(uint32_t mmsi)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int b = BloomBit(mmsi, k);
+			bloom[b >> 6] |= 1ULL << (b & 63);
+		}
+	}
+
+	bool LogBlock::hasMMSI(uint32_t mmsi) const
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int b = BloomBit(mmsi, k);
+			if (!(bloom[b >> 6] & (1ULL << (b & 63)))) return false;
+		}
+		return true;
+	}
+
+	void BinaryLog::openFile(std::string filename)
+	{
+		block.resize(sizeof(LogBlock) + BlockSize);
+		memset(&header, 0, sizeof(header));
+
+		writer.openFile(filename);
+	}
+
+	BinaryLog::~BinaryLog()
+	{
+		writeBlock();
+	}
+
+	void BinaryLog::writeBlock()
+	{
+		if (block.empty() || header.count == 0) return;
+
+		header.magic = LogBlock::Magic;
+		header.size = n;
+
+		memcpy(block.data(), &header, sizeof(LogBlock));
+		writer.write(block.data(), sizeof(LogBlock) + n);
+
+		memset(&header, 0, sizeof(header));
+		n = 0;
+	}
+
+	void BinaryLog::Receive(const NMEA* data, int len)
+	{
+		uint64_t now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+
+		for (int i = 0; i < len; i++)
+		{
+			const NMEA& m = data[i];
+
+			LogRecord r;
+			int bytes = (m.nBits + 7) / 8;
+
+			r.length = sizeof(LogRecord) + bytes;
+			r.channel = m.channel; r.msg = m.msg; r.mmsi = m.mmsi;
+			r.time = now; r.start = m.start;
+			r.offset = m.offset; r.signal = m.signal; r.noise = m.noise;
+			r.nBits = m.nBits; r.lane = m.lane; r.model = m.model;
+
+			if (n + r.length > BlockSize) writeBlock();
+
+			char* p = block.data() + sizeof(LogBlock) + n;
+			memcpy(p, &r, sizeof(LogRecord));
+			memcpy(p + sizeof(LogRecord), m.payload, bytes);
+			n += r.length;
+
+			if (header.count++ == 0) header.first = now;
+			header.last = now;
+			header.addMMSI(m.mmsi);
+		}
+
+		if (header.count > 0 && now - header.first > FlushInterval * 1000) writeBlock();
+	}
+
+	void BinaryLog::flushOld()
+	{
+		if (header.count == 0) return;
+
+		uint64_t now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+		if (now - header.first > FlushInterval * 1000) writeBlock();
+	}
+
+	// BinaryLogReader
+
+#ifndef WIN32
+
+	void BinaryLogReader::openFile(std::string filename)
+	{
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1) throw "Cannot open binary log file.";
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) { close(fd); throw "Cannot read binary log file."; }
+		size = st.st_size;
+
+		if (size > 0)
+		{
+			void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) { close(fd); throw "Cannot map binary log file."; }
+			data = (const char*)p;
+		}
+		close(fd);
+	}
+
+	BinaryLogReader::~BinaryLogReader()
+	{
+		if (data) munmap((void*)data, size);
+	}
+
+#else
+
+	void BinaryLogReader::openFile(std::string filename)
+	{
+		throw "Binary log reader not available on this platform.";
+	}
+
+	BinaryLogReader::~BinaryLogReader() {}
+
+#endif
+
+	// a damaged block, e.g. cut short by a crash before more blocks were appended, is skipped by searching
+	// forward for the next header that fits in the file
+	void BinaryLogReader::query(uint32_t mmsi, uint64_t from, uint64_t to, std::function<void(const LogRecord&, const uint8_t*)> f)
+	{
+		size_t pos = 0;
+		blocks = scanned = 0;
+
+		while (pos + sizeof(LogBlock) <= size)
+		{
+			LogBlock h;
+			memcpy(&h, data + pos, sizeof(LogBlock));
+
+			if (h.magic != LogBlock::Magic || h.size > size - pos - sizeof(LogBlock))
+			{
+				pos++;
+				continue;
+			}
+
+			const char* records = data + pos + sizeof(LogBlock);
+			pos += sizeof(LogBlock) + h.size;
+			blocks++;
+
+			if (h.last < from || h.first > to || !h.hasMMSI(mmsi)) continue;
+			scanned++;
+
+			for (uint32_t i = 0; i + sizeof(LogRecord) <= h.size; )
+			{
+				LogRecord r;
+				memcpy(&r, records + i, sizeof(LogRecord));
+
+				if (r.length < sizeof(LogRecord) || i + r.length > h.size) break;
+
+				if (r.mmsi == mmsi && r.time >= from && r.time <= to)
+					f(r, (const uint8_t*)(records + i + sizeof(LogRecord)));
+
+				i += r.length;
+			}
+		}
+	}
+
+	// TCPServer
+
+	void TCPServer::Receive(const NMEA* data, int len)
+	{
+		if (!running) return;
+
+		uint64_t h = head.load(std::memory_order_relaxed);
+
+		for (int i = 0; i < len; i++)
+		{
+			for (int j = 0; j < data[i].nSentences; j++)
+				for (int k = 0; k < data[i].length[j] + 2; k++)
+					ring[(h++) & (RingSize - 1)] = data[i].sentence[j][k];
+
+			head.store(h, std::memory_order_release);
+		}
+
+#ifdef __linux__
+		uint64_t one = 1;
+		if (write(event_fd, &one, sizeof(one)) < 0) return;
+#endif
+	}
+
+	void TCPServer::ReceiveText(const char* data, int len)
+	{
+		if (!running) return;
+
+		uint64_t h = head.load(std::memory_order_relaxed);
+
+		for (int k = 0; k < len; k++)
+		{
+			ring[(h++) & (RingSize - 1)] = data[k];
+			if ((h & (MaxMessageBytes - 1)) == 0) head.store(h, std::memory_order_release);
+		}
+
+		head.store(h, std::memory_order_release);
+
+#ifdef __linux__
+		uint64_t one = 1;
+		if (write(event_fd, &one, sizeof(one)) < 0) return;
+#endif
+	}
+
+#ifdef __linux__
+
+	void TCPServer::openServer(std::string portname)
+	{
+		ring.resize(RingSize);
+
+		struct addrinfo h, *address = NULL;
+		memset(&h, 0, sizeof(h));
+		h.ai_family = AF_INET6;
+		h.ai_socktype = SOCK_STREAM;
+		h.ai_flags = AI_PASSIVE;
+
+		if (getaddrinfo(NULL, portname.c_str(), &h, &address) != 0 || address == NULL)
+			throw "TCP port not valid.";
+
+		listen_sock = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+
+		int on = 1, off = 0;
+		if (listen_sock != -1)
+		{
+			setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			setsockopt(listen_sock, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		}
+
+		if (listen_sock == -1 || bind(listen_sock, address->ai_addr, address->ai_addrlen) != 0 || listen(listen_sock, 16) != 0)
+		{
+			freeaddrinfo(address);
+			throw "Cannot open TCP server on this port.";
+		}
+		freeaddrinfo(address);
+
+		epoll_fd = epoll_create1(0);
+		event_fd = eventfd(0, EFD_NONBLOCK);
+
+		if (epoll_fd == -1 || event_fd == -1) throw "Cannot create TCP server.";
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+
+		ev.events = EPOLLIN; ev.data.fd = listen_sock;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_sock, &ev);
+
+		ev.events = EPOLLIN; ev.data.fd = event_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+
+		running = true;
+		server_thread = std::thread(&TCPServer::run, this);
+	}
+
+	TCPServer::~TCPServer()
+	{
+		if (running)
+		{
+			running = false;
+
+			uint64_t one = 1;
+			if (write(event_fd, &one, sizeof(one)) < 0) {}
+
+			if (server_thread.joinable()) server_thread.join();
+		}
+
+		for (auto& c : clients) close(c.sock);
+
+		if (listen_sock != -1) close(listen_sock);
+		if (epoll_fd != -1) close(epoll_fd);
+		if (event_fd != -1) close(event_fd);
+	}
+
+	void TCPServer::accept()
+	{
+		int s;
+
+		while ((s = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK)) != -1)
+		{
+			if (clients.size() == MaxClients)
+			{
+				close(s);
+				continue;
+			}
+
+			struct epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLRDHUP; ev.data.fd = s;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &ev);
+
+			clients.push_back({ s, head.load(std::memory_order_acquire), false });
+		}
+	}
+
+	void TCPServer::drop(Client& c)
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.sock, NULL);
+		close(c.sock);
+		c.sock = -1;
+	}
+
+	// send what the client has not seen yet, without blocking. The writer may be up to MaxMessageBytes beyond the
+	// published head, so a client that lags more than MaxLag, before or after sending, is dropped.
+	void TCPServer::send(Client& c)
+	{
+		uint64_t h = head.load(std::memory_order_acquire);
+
+		while (c.pos < h && h - c.pos <= MaxLag)
+		{
+			uint64_t start = c.pos;
+			int chunk = (int)std::min(h - c.pos, (uint64_t)(RingSize - (c.pos & (RingSize - 1))));
+
+			ssize_t n = ::send(c.sock, ring.data() + (c.pos & (RingSize - 1)), chunk, MSG_NOSIGNAL);
+
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				if (!c.waiting)
+				{
+					struct epoll_event ev;
+					memset(&ev, 0, sizeof(ev));
+					ev.events = EPOLLOUT | EPOLLRDHUP; ev.data.fd = c.sock;
+					epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.sock, &ev);
+					c.waiting = true;
+				}
+				return;
+			}
+
+			if (n <= 0) break;
+
+			// the writer overwrote what was just sent
+			if (head.load(std::memory_order_acquire) - start > MaxLag) break;
+
+			c.pos += n;
+		}
+
+		// error, closed or too far behind
+		if (c.pos != h)
+		{
+			drop(c);
+			return;
+		}
+
+		if (c.waiting)
+		{
+			struct epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLRDHUP; ev.data.fd = c.sock;
+			epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.sock, &ev);
+			c.waiting = false;
+		}
+	}
+
+	void TCPServer::run()
+	{
+		const int MaxEvents = 16;
+		struct epoll_event events[MaxEvents];
+
+		while (running)
+		{
+			int n = epoll_wait(epoll_fd, events, MaxEvents, -1);
+
+			for (int i = 0; i < n; i++)
+			{
+				int fd = events[i].data.fd;
+
+				if (fd == listen_sock)
+					accept();
+				else if (fd == event_fd)
+				{
+					uint64_t count;
+					if (read(event_fd, &count, sizeof(count)) < 0) {}
+
+					for (auto& c : clients)
+						if (!c.waiting && c.sock != -1) send(c);
+				}
+				else
+				{
+					for (auto& c : clients)
+					{
+						if (c.sock != fd) continue;
+
+						if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+							drop(c);
+						else
+							send(c);
+					}
+				}
+			}
+
+			for (int k = (int)clients.size() - 1; k >= 0; k--)
+				if (clients[k].sock == -1) clients.erase(clients.begin() + k);
+		}
+	}
+
+#else
+
+	void TCPServer::openServer(std::string portname)
+	{
+		throw "TCP server not available on this platform.";
+	}
+
+	TCPServer::~TCPServer() {}
+
+#endif
 }
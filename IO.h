@@ -21,8 +21,17 @@ SOFTWARE.
 */
 
 #pragma once
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 #ifdef WIN32
 #include <winsock2.h>
@@ -30,12 +39,16 @@ SOFTWARE.
 #else
 #include <sys/socket.h>
 #include <netdb.h>
+#include <unistd.h>
 #endif
 
 #include "Stream.h"
 
 namespace IO
 {
+	// power in dB for display, -100 dB for powers at or below 1e-10
+	inline int PowerToDB(float p) { return p > 1e-10f ? (int)(10 * std::log10(p)) : -100; }
+
 	template<typename T>
 	class SampleCounter : public StreamIn<T>
 	{
@@ -78,47 +91,229 @@ namespace IO
 		}
 	};
 
+	// File output through a background thread. write() copies a record into one of a fixed set of large, page
+	// aligned buffers and hands full buffers to the writer thread, which does all file calls including the fsync
+	// every SyncInterval seconds and at rotation. The writer thread wakes up at least every FlushInterval seconds
+	// to pass on a buffer older than that and to rotate by time, so a quiet stream still reaches the disk. The file can be rotated
+	// after a size or a time, only between records: the files are then named filename.yyyymmdd-hhmmss.nnn (UTC).
+	// If all buffers are in flight, records are dropped (live input) or write() waits (file input).
+	class FileWriter
+	{
+		struct Job
+		{
+			int buffer;	// -1 for a rotation only
+			bool rotate;
+		};
+
+		static const int BufferSize = 1 << 20;
+		static const int nBuffers = 8;
+		static const int Alignment = 4096;
+		static const int FlushInterval = 1;
+		static const int SyncInterval = 10;
+
+		std::string filename;
+		uint64_t rotate_size = 0;
+		int rotate_time = 0;
+		bool wait = false;
+
+		std::vector<char> storage;
+		std::vector<char*> buffers;
+
+		// shared with the writer thread, which also passes on the current buffer once it is old
+		std::mutex mtx;
+		std::condition_variable cv_jobs, cv_free;
+		std::queue<Job> jobs;
+		std::vector<int> free_buffers;
+		std::vector<int> length;
+		int current = -1;
+		uint64_t file_bytes = 0;
+		uint64_t dropped = 0;
+		steady_clock::time_point file_opened, buffer_started;
+		bool running = false;
+
+		// writer thread
+		FILE* file = NULL;
+		int sequence = 0;
+		bool dirty = false;
+		steady_clock::time_point last_sync;
+
+		std::thread writer_thread;
+
+		// with mtx held
+		bool acquire(std::unique_lock<std::mutex>& lock, int len);
+		void handOff(bool rotate);
+		void startRotation(steady_clock::time_point now);
+		void checkTime(steady_clock::time_point now);
+
+		void run();
+		void writeBuffer(int buffer);
+		void sync();
+		void openNext();
+		void closeFile();
+
+	public:
+
+		~FileWriter() { stop(); }
+
+		void setRotation(uint64_t bytes, int seconds) { rotate_size = bytes; rotate_time = seconds; }
+		void setWait(bool b) { wait = b; }
+		uint64_t getDropped() { return dropped; }
+
+		void openFile(std::string fn);
+		void write(const char* data, int len);
+		void stop();
+	};
+
+	// samples or text to file, one record per Receive so a rotation never splits a block or a line
 	template <typename T>
 	class DumpFile : public StreamIn<T>
 	{
-		std::ofstream file;
-		std::string filename;
+		FileWriter writer;
 
 	public:
 
-		~DumpFile()
-		{
-			if (file.is_open())
-				file.close();
-		}
-		void openFile(std::string fn)
-		{
-			filename = fn;
-			file.open(filename, std::ios::out | std::ios::binary);
-		}
+		void setRotation(uint64_t bytes, int seconds) { writer.setRotation(bytes, seconds); }
+		void setWait(bool b) { writer.setWait(b); }
+		uint64_t getDropped() { return writer.getDropped(); }
+
+		void openFile(std::string fn) { writer.openFile(fn); }
 
 		void Receive(const T* data, int len)
 		{
-			file.write((char*)data, len * sizeof(T));
+			writer.write((char*)data, len * sizeof(T));
 		}
 	};
 
-	class DumpScreen : public StreamIn<NMEA>
+	// NMEA files hold the sentences, the sentences of a message form one record
+	template <>
+	inline void DumpFile<NMEA>::Receive(const NMEA* data, int len)
 	{
-	public:
+		char record[NMEA::MaxSentences * (NMEA::MaxLength + 2)];
 
-		void Receive(const NMEA* data, int len)
+		for (int i = 0; i < len; i++)
 		{
-			for (int i = 0; i < len; i++)
-				for (auto s : data[i].sentence)
-					std::cout << s << " ( MSG: " << data[i].msg << ", REPEAT: " << data[i].repeat << ", MMSI: " << data[i].mmsi << ")" << std::endl;
+			int n = 0;
+			for (int j = 0; j < data[i].nSentences; j++)
+			{
+				memcpy(record + n, data[i].sentence[j], data[i].length[j] + 2);
+				n += data[i].length[j] + 2;
+			}
+			writer.write(record, n);
 		}
+	}
+
+	// text input of a sink next to its NMEA input, e.g. for JSON lines, forwarded to ReceiveText of the sink
+	template <typename C>
+	class TextIn : public StreamIn<char>
+	{
+		C* parent;
+
+	public:
+		TextIn(C* p) : parent(p) {}
+		void Receive(const char* data, int len) { parent->ReceiveText(data, len); }
 	};
 
-	class UDP : public StreamIn<NMEA>
+	// sinks that buffer their output, flushed by the output thread whenever its queue is empty
+	class Flushable
 	{
-		int sock;
-		struct addrinfo* address;
+	public:
+		virtual void flush() = 0;
+	};
+
+	class DumpScreen : public StreamIn<NMEA>, public Flushable
+	{
+		static const int BufferSize = 1 << 16;
+
+		bool metadata = false;
+
+		char buffer[BufferSize];
+		int n = 0;
+
+		TextIn<DumpScreen> text = TextIn<DumpScreen>(this);
+
+	public:
+
+		void setMetadata(bool b) { metadata = b; }
+		void Receive(const NMEA* data, int len);
+		void ReceiveText(const char* data, int len);
+		void flush();
+
+		StreamIn<char>& Text() { return text; }
+	};
+
+	// Decouples the sinks from the DSP thread: Receive copies the frames into a bounded single producer, single
+	// consumer queue and a dedicated thread passes them on and flushes the buffered sinks when it runs out of work.
+	// If the queue is full, frames are dropped (live input) or Receive waits for space (file input).
+	class AsyncOutput : public SimpleStreamInOut<NMEA, NMEA>
+	{
+		static const int QueueSize = 1024;
+		static const int MaxBatch = 64;
+
+		std::vector<NMEA> queue;
+		std::atomic<uint64_t> head, tail;
+
+		std::vector<Flushable*> flushables;
+
+		bool wait = false;
+		uint64_t dropped = 0;
+
+		std::atomic<bool> running;
+		std::thread output_thread;
+
+		void run();
+
+	public:
+
+		AsyncOutput() : head(0), tail(0), running(false) {}
+		~AsyncOutput() { stop(); }
+
+		void setWait(bool b) { wait = b; }
+		void addFlushable(Flushable* f) { flushables.push_back(f); }
+		uint64_t getDropped() { return dropped; }
+
+		void start();
+		void stop();
+
+		void Receive(const NMEA* data, int len);
+	};
+
+	// Sentences are copied into a fixed batch and sent to all destinations once the batch is full or at the end
+	// of a block of samples from the device, on Linux with one sendmmsg call per destination. Lines on the text
+	// input are sent the same way, one per datagram.
+	class UDP : public StreamIn<NMEA>, public Flushable
+	{
+		class Flush : public StreamIn<CFLOAT32>
+		{
+			UDP* parent;
+
+		public:
+			Flush(UDP* p) : parent(p) {}
+			void Receive(const CFLOAT32* data, int len) { parent->flush(); }
+		};
+
+		struct Destination
+		{
+			int sock;
+			struct addrinfo* address;
+		};
+
+		static const int MaxBatch = 64;
+		static const int MaxLength = 1024;
+
+		std::vector<Destination> destinations;
+
+		char batch[MaxBatch][MaxLength];
+		int length[MaxBatch];
+		int nBatch = 0;
+
+		TextIn<UDP> text = TextIn<UDP>(this);
+
+#ifdef __linux__
+		struct iovec iov[MaxBatch];
+		struct mmsghdr msgs[MaxBatch];
+#endif
+		Flush block_end = Flush(this);
+
 #ifdef WIN32
 		WSADATA wsaData;
 #endif
@@ -128,8 +323,164 @@ namespace IO
 	public:
 
 		void Receive(const NMEA* data, int len);
+		void ReceiveText(const char* data, int len);
+		void flush();
+
+		// adds a destination, can be called more than once
 		void openConnection(std::string host, std::string portname);
 
-		~UDP() { closeWSA(); }
+		// connect to the device output, after the models
+		StreamIn<CFLOAT32>& BlockEnd() { return block_end; }
+		StreamIn<char>& Text() { return text; }
+
+		~UDP();
+	};
+
+	// Binary message log: the file holds a sequence of blocks, each a LogBlock header followed by length prefixed
+	// records. The header carries the time range of the block and a bloom filter of its MMSIs, together the headers
+	// are a sparse index by time and MMSI so a query only reads the records of blocks that can match.
+	struct LogBlock
+	{
+		static const uint32_t Magic = 0x4b4c4241; // "ABLK"
+		static const int BloomWords = 32;
+
+		uint32_t magic;
+		uint32_t size;		// bytes of records after the header
+		uint32_t count;
+		uint32_t reserved;
+		uint64_t first, last;	// time of the first and last record, ms since the epoch
+		uint64_t bloom[BloomWords];
+
+		void addMMSI(uint32_t mmsi);
+		bool hasMMSI(uint32_t mmsi) const;
+	};
+
+	// record header, followed by the (nBits + 7) / 8 payload bytes, records are not aligned in the block
+	struct LogRecord
+	{
+		uint16_t length;	// bytes of the record including the payload
+		uint8_t channel, msg;
+		uint32_t mmsi;
+		uint64_t time;
+		uint64_t start;
+		float offset, signal, noise;
+		uint16_t nBits;
+		uint8_t lane, model;
+	};
+
+	// records are collected in memory and a block is written when it is full, when its oldest record is more
+	// than FlushInterval seconds old (checked per message and at the end of each device block) and at exit
+	class BinaryLog : public StreamIn<NMEA>
+	{
+		class Flush : public StreamIn<CFLOAT32>
+		{
+			BinaryLog* parent;
+
+		public:
+			Flush(BinaryLog* p) : parent(p) {}
+			void Receive(const CFLOAT32* data, int len) { parent->flushOld(); }
+		};
+
+		static const int BlockSize = 1 << 16;
+		static const int FlushInterval = 60;
+
+		FileWriter writer;
+
+		// the header is filled in at the front of the block so the block is written as one record
+		LogBlock header = {};
+		std::vector<char> block;
+		int n = 0;
+
+		Flush block_end = Flush(this);
+
+		void writeBlock();
+		void flushOld();
+
+	public:
+
+		~BinaryLog();
+
+		void setRotation(uint64_t bytes, int seconds) { writer.setRotation(bytes, seconds); }
+		void setWait(bool b) { writer.setWait(b); }
+		uint64_t getDropped() { return writer.getDropped(); }
+
+		void openFile(std::string filename);
+		void Receive(const NMEA* data, int len);
+
+		// connect to the device output so a block is also written on a quiet channel
+		StreamIn<CFLOAT32>& BlockEnd() { return block_end; }
+	};
+
+	// maps a binary log in memory and walks the block headers, only blocks that overlap the time range and may
+	// contain the MMSI are scanned. A block cut short at the end of the file (e.g. after a crash) ends the log.
+	class BinaryLogReader
+	{
+		const char* data = NULL;
+		size_t size = 0;
+
+		uint64_t blocks = 0;
+		uint64_t scanned = 0;
+
+	public:
+
+		~BinaryLogReader();
+
+		void openFile(std::string filename);
+
+		// calls f for every record of mmsi with a time in [from, to], times in ms since the epoch
+		void query(uint32_t mmsi, uint64_t from, uint64_t to, std::function<void(const LogRecord&, const uint8_t*)> f);
+
+		uint64_t getBlocks() { return blocks; }
+		uint64_t getScanned() { return scanned; }
+	};
+
+	// NMEA over TCP to any number of clients (Linux). Receive appends the sentences once to a ring buffer and wakes
+	// the server thread, which runs an epoll loop and keeps a read position per client. New clients start at the
+	// newest sentence, a client that falls more than the ring size behind is disconnected.
+	class TCPServer : public StreamIn<NMEA>
+	{
+		struct Client
+		{
+			int sock;
+			uint64_t pos;
+			bool waiting;
+		};
+
+		static const int RingSize = 1 << 20;
+		static const int MaxClients = 64;
+
+		// the writer publishes the head at least every MaxMessageBytes, so at most that many bytes beyond the head
+		// may be in the middle of being overwritten
+		static const int MaxMessageBytes = 4096;
+		static const int MaxLag = RingSize - MaxMessageBytes;
+
+		std::vector<char> ring;
+		std::atomic<uint64_t> head;
+
+		std::vector<Client> clients;
+		int listen_sock = -1;
+		int epoll_fd = -1;
+		int event_fd = -1;
+
+		std::atomic<bool> running;
+		std::thread server_thread;
+
+		TextIn<TCPServer> text = TextIn<TCPServer>(this);
+
+		void run();
+		void accept();
+		void send(Client& c);
+		void drop(Client& c);
+
+	public:
+
+		TCPServer() : head(0), running(false) {}
+		~TCPServer();
+
+		void openServer(std::string portname);
+		void Receive(const NMEA* data, int len);
+		void ReceiveText(const char* data, int len);
+
+		StreamIn<char>& Text() { return text; }
 	};
 }
@@ -25,11 +25,14 @@ SOFTWARE.
 #include <cctype>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
+#include <ctime>
 
 #include "Signal.h"
 #include "Device.h"
 #include "IO.h"
 #include "Model.h"
+#include "Message.h"
 
 MessageHub<SystemMessage> SystemMessages;
 
@@ -88,6 +91,54 @@ int getNumber(std::string str, int min, int max)
 	return number;
 }
 
+// file output with optional rotation
+struct FileOutput
+{
+	std::string filename = "";
+	uint64_t rotate_size = 0;
+	int rotate_time = 0;
+};
+
+// rotation after xxM or xxG bytes, or after xxs seconds or xxh hours
+void getRotation(std::string str, FileOutput& f)
+{
+	if (str.length() < 2) throw "Error on command line. Not a valid rotation.";
+
+	int n = getNumber(str.substr(0, str.length() - 1), 1, 1000000);
+
+	switch (str.back())
+	{
+	case 'M': f.rotate_size = (uint64_t)n << 20; break;
+	case 'G': f.rotate_size = (uint64_t)n << 30; break;
+	case 's': f.rotate_time = n; break;
+	case 'h': f.rotate_time = n * 3600; break;
+	default: throw "Error on command line. Not a valid rotation.";
+	}
+}
+
+// record from the binary log with the payload in the 6 bit armoring of an NMEA sentence
+void printLogRecord(const IO::LogRecord& r, const uint8_t* payload)
+{
+	char text[NMEA::MaxPayload * 8 / 6 + 2];
+	int n = 0;
+
+	for (int i = 0; i < r.nBits; i += 6)
+	{
+		int c = 0;
+		for (int j = i; j < i + 6; j++)
+			c = (c << 1) | (j < r.nBits ? (payload[j >> 3] >> (7 - (j & 7))) & 1 : 0);
+		text[n++] = c < 40 ? c + 48 : c + 56;
+	}
+	text[n] = 0;
+
+	time_t t = r.time / 1000;
+	char timestamp[32];
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+
+	std::cout << timestamp << "." << std::setfill('0') << std::setw(3) << r.time % 1000 << std::setfill(' ') << " " << r.channel << " " << text << "," << (6 * n - r.nBits)
+		<< " ( MSG: " << (int)r.msg << ", MMSI: " << r.mmsi << ", SIGNAL: " << IO::PowerToDB(r.signal) << " dB, NOISE: " << IO::PowerToDB(r.noise) << " dB, MODEL: " << (int)r.model << ")" << std::endl;
+}
+
 void Usage()
 {
 	std::cerr << "use: AIS-catcher [options]" << std::endl;
@@ -96,7 +147,15 @@ void Usage()
 	std::cerr << "\t[-s xxx sample rate in Hz (default: based on SDR device)]" << std::endl;
 	std::cerr << "\t[-v [option: xx] enable verbose mode, optional to provide update frequency in seconds (default: false)]" << std::endl;
 	std::cerr << "\t[-q surpress NMEA messages to screen (default: false)]" << std::endl;
-	std::cerr << "\t[-u address port - UDP address and port (default: off)]" << std::endl;
+	std::cerr << "\t[-x show reception details per message on screen: start symbol, frequency offset, signal and noise, timing bucket and model (default: off)]" << std::endl;
+	std::cerr << "\t[-u address port - UDP address and port, repeat for more destinations (default: off)]" << std::endl;
+	std::cerr << "\t[-y port - serve NMEA to TCP clients on port (default: off)]" << std::endl;
+	std::cerr << "\t[-j decoded messages as JSON instead of NMEA to screen, UDP and TCP (default: off)]" << std::endl;
+	std::cerr << "\t[-e nmea filename [xx] - append NMEA to file, optionally rotate after xxM or xxG bytes or after xxs seconds or xxh hours (default: off)]" << std::endl;
+	std::cerr << "\t[-e log filename [xx] - append messages to a binary log with a time and MMSI index (default: off)]" << std::endl;
+	std::cerr << "\t[-e json filename [xx] - append decoded messages as JSON to file (default: off)]" << std::endl;
+	std::cerr << "\t[-e iq filename [xx] - append the IQ samples from the device as 'float' to file (default: off)]" << std::endl;
+	std::cerr << "\t[-z filename mmsi from to - print the messages of mmsi between from and to (seconds since 1970 UTC) in a binary log and terminate]" << std::endl;
 	std::cerr << std::endl;
 	std::cerr << "\t[-r filename - read IQ data from raw \'unsigned char\' file]" << std::endl;
 	std::cerr << "\t[-r cu8 filename - read IQ data from raw \'unsigned char\' file]" << std::endl;
@@ -113,8 +172,15 @@ void Usage()
 #endif
 	std::cerr << std::endl;
 	std::cerr << "\t[-m xx run specific decoding model (default: 2)]" << std::endl;
-	std::cerr << "\t[\t0: Standard (non-coherent), 1: Base (non-coherent), 2: Default, 3: FM discrimator output]" << std::endl;
+	std::cerr << "\t[\t0: Standard (non-coherent), 1: Base (non-coherent), 2: Default, 3: FM discrimator output, 5: Viterbi (experimental)]" << std::endl;
 	std::cerr << "\t[-b benchmark demodulation models - for development purposes (default: off)]" << std::endl;
+	std::cerr << "\t[-t estimate the phase per burst from the training sequence and track it (default: off)]" << std::endl;
+	std::cerr << "\t[-f xx on a CRC failure retry flips of the xx least reliable bits, at most 2^xx-1 checks per frame, fixed length messages only (default: 0)]" << std::endl;
+	std::cerr << "\t[-c xx on a CRC failure correct up to xx (1 or 2) bit errors from the syndrome, fixed length messages only (default: 0)]" << std::endl;
+	std::cerr << "\t[-k keep only the best timing bucket once a frame starts (default: off)]" << std::endl;
+	std::cerr << "\t[-n xx samples per symbol in the back-end: 3 (28.8 kS/s), 5 (48 kS/s) or 10 (96 kS/s), models 2 and 4 (default: 5)]" << std::endl;
+	std::cerr << "\t[-g only demodulate around a detected training sequence and start flag, models 2 and 4 (default: off)]" << std::endl;
+	std::cerr << "\t[-a xx atan2 in FM discriminator - 0: exact, 1: max error 1.8e-6 rad, 2: max error 6.1e-4 rad (default: 1)]" << std::endl;
 	std::cerr << std::endl;
 }
 
@@ -173,6 +239,7 @@ std::vector<AIS::Model*> setupModels(std::vector<int> &liveModelsSelected, Devic
 		case 2: liveModels.push_back(new AIS::ModelCoherent(control, out)); break;
 		case 3: liveModels.push_back(new AIS::ModelDiscriminator(control, out)); break;
 		case 4: liveModels.push_back(new AIS::ModelChallenger(control, out)); break;
+		case 5: liveModels.push_back(new AIS::ModelViterbi(control, out)); break;
 		default: throw "Internal error: Model not implemented in this version. Check in later."; break;
 		}
 	}
@@ -211,6 +278,16 @@ int main(int argc, char* argv[])
 	bool timer_on = false;
 	bool NMEA_to_screen = true;
 	bool RTLSDRfastDS = true;
+	DSP::FMPrecision fm_precision = DSP::FMPrecision::HIGH;
+	bool phase_tracking = false;
+	int repair_bits = 0;
+	int correct_bits = 0;
+	int timing_neighbours = -1;
+	bool bucket_pruning = false;
+	int oversampling = 5;
+	bool burst_detection = false;
+	bool show_metadata = false;
+	bool json = false;
 	int verboseUpdateTime = 3000;
 
 	int ppm_correction = 0;
@@ -219,14 +296,27 @@ int main(int argc, char* argv[])
 
 	std::string filename_in = "";
 	std::string filename_out = "";
-	std::string udp_address = "";
-	std::string udp_port = "";
+	std::vector<std::string> udp_address;
+	std::vector<std::string> udp_port;
+	std::string tcp_port = "";
+	FileOutput nmea_file, log_file, json_file, iq_file;
+	std::string query_file = "";
+	int query_mmsi = 0, query_from = 0, query_to = 0;
 
 	std::vector<AIS::Model*> liveModels;
 	std::vector<int> liveModelsSelected;
 	Device::Type input_type = Device::Type::NONE;
 	IO::UDP udp;
+	IO::TCPServer tcp;
+	IO::BinaryLog binary_log;
+	IO::DumpFile<NMEA> nmea_dump;
+	IO::DumpFile<char> json_dump;
+	IO::DumpFile<CFLOAT32> iq_dump;
+	AIS::PayloadDecoder payload_decoder;
+	AIS::JSONWriter json_writer;
 	IO::DumpScreen nmea_screen;
+	IO::AsyncOutput async_output;
+	Util::Deduplicate merge;
 
 	try
 	{
@@ -275,9 +365,51 @@ int main(int argc, char* argv[])
 			case 'q':
 				NMEA_to_screen = false;
 				break;
+			case 'j':
+				json = true;
+				break;
 			case 'b':
 				timer_on = true;
 				break;
+			case 'a':
+				switch (getNumber(arg1, 0, 2))
+				{
+				case 0: fm_precision = DSP::FMPrecision::EXACT; break;
+				case 1: fm_precision = DSP::FMPrecision::HIGH; break;
+				case 2: fm_precision = DSP::FMPrecision::LOW; break;
+				}
+				ptr++;
+				break;
+			case 't':
+				phase_tracking = true;
+				break;
+			case 'f':
+				repair_bits = getNumber(arg1, 0, 10);
+				ptr++;
+				break;
+			case 'c':
+				correct_bits = getNumber(arg1, 0, 2);
+				ptr++;
+				break;
+			case 'i':
+				// development only, the interpolating sampler does not match the buckets yet and is not in the usage
+				timing_neighbours = getNumber(arg1, 0, 2);
+				ptr++;
+				break;
+			case 'k':
+				bucket_pruning = true;
+				break;
+			case 'n':
+				oversampling = getNumber(arg1, 3, 10);
+				if (oversampling != 3 && oversampling != 5 && oversampling != 10) throw "Error on command line. Samples per symbol must be 3, 5 or 10.";
+				ptr++;
+				break;
+			case 'g':
+				burst_detection = true;
+				break;
+			case 'x':
+				show_metadata = true;
+				break;
 			case 'w':
 				input_type = Device::Type::WAVFILE;
 				filename_in = arg1;
@@ -325,8 +457,43 @@ int main(int argc, char* argv[])
 				}
 				break;
 			case 'u':
-				udp_address = arg1; udp_port = arg2;
+				udp_address.push_back(arg1); udp_port.push_back(arg2);
+				ptr += 2;
+				break;
+			case 'y':
+				tcp_port = arg1;
+				ptr++;
+				break;
+			case 'e':
+			{
+				FileOutput* f = NULL;
+
+				if (arg1 == "nmea") f = &nmea_file;
+				else if (arg1 == "log") f = &log_file;
+				else if (arg1 == "json") f = &json_file;
+				else if (arg1 == "iq") f = &iq_file;
+				else
+				{
+					std::cerr << "Unsupported output file type specified : " << arg1 << std::endl;
+					return -1;
+				}
+				f->filename = arg2;
 				ptr += 2;
+
+				if (ptr + 1 < argc && argv[ptr + 1][0] != '-')
+				{
+					getRotation(std::string(argv[ptr + 1]), *f);
+					ptr++;
+				}
+				break;
+			}
+			case 'z':
+				if (ptr + 4 >= argc) throw "Error on command line. Query needs a file, MMSI, start and end time.";
+				query_file = arg1;
+				query_mmsi = getNumber(arg2, 0, 999999999);
+				query_from = getNumber(std::string(argv[ptr + 3]), 0, 2147483647);
+				query_to = getNumber(std::string(argv[ptr + 4]), 0, 2147483647);
+				ptr += 4;
 				break;
 			case 'h':
 				Usage();
@@ -351,6 +518,18 @@ int main(int argc, char* argv[])
 			return 0;
 		}
 
+		if (query_file != "")
+		{
+			IO::BinaryLogReader reader;
+
+			reader.openFile(query_file);
+			reader.query(query_mmsi, (uint64_t)query_from * 1000, (uint64_t)query_to * 1000 + 999, printLogRecord);
+
+			if (verbose)
+				std::cerr << "[Log]\t: scanned " << reader.getScanned() << " of " << reader.getBlocks() << " blocks" << std::endl;
+			return 0;
+		}
+
 		// Select device
 
 		if (input_type == Device::Type::NONE)
@@ -451,22 +630,108 @@ int main(int argc, char* argv[])
 		// Build model and attach output to main model
 
 		std::vector<IO::SampleCounter<NMEA>> statistics(verbose ? liveModels.size() : 0);
+		merge.setInputs(liveModels.size());
 
 		for (int i = 0; i < liveModels.size(); i++)
 		{
+			liveModels[i]->setID(i);
+			liveModels[i]->setFMPrecision(fm_precision);
+			liveModels[i]->setPhaseTracking(phase_tracking);
+			liveModels[i]->setRepairBits(repair_bits);
+			liveModels[i]->setCorrectBits(correct_bits);
+			liveModels[i]->setTimingRecovery(timing_neighbours);
+			liveModels[i]->setBucketPruning(bucket_pruning);
+			liveModels[i]->setOversampling(oversampling);
+			liveModels[i]->setBurstDetection(burst_detection);
 			liveModels[i]->buildModel(model_rate, timer_on);
 			if (verbose) liveModels[i]->Output() >> statistics[i];
+			liveModels[i]->Output() >> merge.in(i);
+		}
+
+		// JSON is decoded and written on the output thread and the outputs that carry it are fed from there
+		bool json_output = json || json_file.filename != "";
+
+		if (NMEA_to_screen || json_output)
+			merge >> async_output;
+
+		if (json_output)
+			async_output >> payload_decoder >> json_writer;
+
+		// Connect output to UDP stream, each frame caught by any of the models once
+		if (!udp_address.empty())
+		{
+			for (int i = 0; i < udp_address.size(); i++)
+				udp.openConnection(udp_address[i], udp_port[i]);
+
+			if (json)
+			{
+				json_writer >> udp.Text();
+				async_output.addFlushable(&udp);
+			}
+			else
+			{
+				merge >> udp;
+				*out >> udp.BlockEnd();
+			}
+		}
+
+		if (tcp_port != "")
+		{
+			tcp.openServer(tcp_port);
+
+			if (json) json_writer >> tcp.Text();
+			else merge >> tcp;
 		}
 
-		// Connect output to UDP stream
-		if (udp_address != "")
+		// files are written by a background thread each, which waits for the disk when reading from a file
+		if (nmea_file.filename != "")
 		{
-			udp.openConnection(udp_address, udp_port);
-			liveModels[0]->Output() >> udp;
+			nmea_dump.setRotation(nmea_file.rotate_size, nmea_file.rotate_time);
+			nmea_dump.setWait(!control->isCallback());
+			nmea_dump.openFile(nmea_file.filename);
+			merge >> nmea_dump;
 		}
 
+		if (log_file.filename != "")
+		{
+			binary_log.setRotation(log_file.rotate_size, log_file.rotate_time);
+			binary_log.setWait(!control->isCallback());
+			binary_log.openFile(log_file.filename);
+			merge >> binary_log;
+			*out >> binary_log.BlockEnd();
+		}
+
+		if (json_file.filename != "")
+		{
+			json_dump.setRotation(json_file.rotate_size, json_file.rotate_time);
+			json_dump.setWait(!control->isCallback());
+			json_dump.openFile(json_file.filename);
+			json_writer >> json_dump;
+		}
+
+		if (iq_file.filename != "")
+		{
+			iq_dump.setRotation(iq_file.rotate_size, iq_file.rotate_time);
+			iq_dump.setWait(!control->isCallback());
+			iq_dump.openFile(iq_file.filename);
+			*out >> iq_dump;
+		}
+
+		// screen output runs on its own thread so a slow terminal does not hold up the DSP
 		if (NMEA_to_screen)
-			liveModels[0]->Output() >> nmea_screen;
+		{
+			nmea_screen.setMetadata(show_metadata);
+			async_output.addFlushable(&nmea_screen);
+
+			if (json) json_writer >> nmea_screen.Text();
+			else async_output >> nmea_screen;
+		}
+
+		if (NMEA_to_screen || json_output)
+		{
+			async_output.setWait(!control->isCallback());
+			async_output.start();
+		}
 
 		// Set up Device
 		control->setSampleRate(sample_rate);
@@ -495,13 +760,40 @@ int main(int argc, char* argv[])
 		}
 
 		control->Pause();
+		async_output.stop();
 
 		if (verbose)
 		{
 			std::cerr << "----------------------" << std::endl;
+
+			if (async_output.getDropped() > 0)
+				std::cerr << "[Output]\t: dropped " << async_output.getDropped() << " msgs" << std::endl;
+
+			uint64_t file_dropped = nmea_dump.getDropped() + binary_log.getDropped() + json_dump.getDropped() + iq_dump.getDropped();
+			if (file_dropped > 0)
+				std::cerr << "[Files]\t: dropped " << file_dropped << " bytes" << std::endl;
+
 			for(int j = 0; j < liveModels.size(); j++)
 				std::cerr << "[" << liveModels[j]->getName() << "]\t: " << statistics[j].getCount() << " msgs at " << std::setprecision(2) << statistics[j].getRate() << " msg/s" << std::endl;
 
+			if (liveModels.size() > 1)
+				for (int j = 0; j < liveModels.size(); j++)
+					std::cerr << "[" << liveModels[j]->getName() << "]\t: first to catch " << merge.getFirst(j) << " of " << merge.getCaught(j) << " msgs" << std::endl;
+
+			if (repair_bits > 0 || correct_bits > 0)
+				for (int j = 0; j < liveModels.size(); j++)
+				{
+					const AIS::RepairStatistics& r = liveModels[j]->getRepairStatistics();
+					std::cerr << "[" << liveModels[j]->getName() << "]\t: of " << r.failed << " failed frames corrected " << r.corrected1 << " single and " << r.corrected2 << " double bit errors, repaired " << r.repaired << " with " << r.evaluations << " CRC checks" << std::endl;
+				}
+
+			if (burst_detection)
+				for (int j = 0; j < liveModels.size(); j++)
+				{
+					uint64_t blocks, forwarded;
+					liveModels[j]->getBurstStatistics(blocks, forwarded);
+					std::cerr << "[" << liveModels[j]->getName() << "]\t: forwarded " << forwarded << " of " << blocks << " blocks to the demodulators" << std::endl;
+				}
 		}
 
 		if(timer_on)
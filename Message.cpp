@@ -0,0 +1,390 @@
+/*
+Copyright(c) 2021 jvde.github@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "Message.h"
+
+// Source: https://gpsd.gitlab.io/gpsd/AIVDM.html
+
+namespace AIS
+{
+	// up to 32 bits from 5 bytes without a loop, the payload is zero padded beyond the frame
+	uint32_t PayloadDecoder::U(int start, int len)
+	{
+		const uint8_t* b = payload + (start >> 3);
+		uint64_t w = ((uint64_t)b[0] << 32) | ((uint64_t)b[1] << 24) | ((uint64_t)b[2] << 16) | ((uint64_t)b[3] << 8) | (uint64_t)b[4];
+
+		return (uint32_t)((w >> (40 - (start & 7) - len)) & (((uint64_t)1 << len) - 1));
+	}
+
+	int PayloadDecoder::S(int start, int len)
+	{
+		return (int32_t)(U(start, len) << (32 - len)) >> (32 - len);
+	}
+
+	// 6-bit ASCII, trailing '@' (padding) and spaces are removed
+	void PayloadDecoder::T(int start, int len, char* s)
+	{
+		int n = len / 6;
+
+		for (int i = 0; i < n; i++)
+		{
+			uint32_t c = U(start + i * 6, 6);
+			s[i] = (char)(c < 32 ? c + 64 : c);
+		}
+
+		while (n > 0 && (s[n - 1] == '@' || s[n - 1] == ' ')) n--;
+		s[n] = 0;
+	}
+
+	Dimensions PayloadDecoder::D(int start)
+	{
+		return { (int)U(start, 9), (int)U(start + 9, 9), (int)U(start + 18, 6), (int)U(start + 24, 6) };
+	}
+
+	bool PayloadDecoder::decode(const NMEA& nmea)
+	{
+		payload = nmea.payload;
+
+		msg.type = U(0, 6);
+		msg.repeat = U(6, 2);
+		msg.mmsi = U(8, 30);
+		msg.channel = nmea.channel;
+		msg.nmea = &nmea;
+
+		int n = nmea.nBits;
+
+		switch (msg.type)
+		{
+		case 1: case 2: case 3:
+		{
+			if (n < 168) return false;
+
+			PositionReport& m = msg.position;
+
+			m.status = U(38, 4); m.turn = S(42, 8); m.speed = U(50, 10); m.accuracy = U(60, 1);
+			m.lon = S(61, 28); m.lat = S(89, 27); m.course = U(116, 12); m.heading = U(128, 9);
+			m.second = U(137, 6); m.maneuver = U(143, 2); m.raim = U(148, 1); m.radio = U(149, 19);
+			return true;
+		}
+		case 4:
+		{
+			if (n < 168) return false;
+
+			BaseStationReport& m = msg.base;
+
+			m.year = U(38, 14); m.month = U(52, 4); m.day = U(56, 5); m.hour = U(61, 5); m.minute = U(66, 6); m.second = U(72, 6);
+			m.accuracy = U(78, 1); m.lon = S(79, 28); m.lat = S(107, 27); m.epfd = U(134, 4); m.raim = U(148, 1); m.radio = U(149, 19);
+			return true;
+		}
+		case 5:
+		{
+			// some transmitters drop the last bits
+			if (n < 420) return false;
+
+			StaticVoyageData& m = msg.voyage;
+
+			m.ais_version = U(38, 2); m.imo = U(40, 30); T(70, 42, m.callsign); T(112, 120, m.shipname);
+			m.shiptype = U(232, 8); m.dim = D(240); m.epfd = U(270, 4);
+			m.month = U(274, 4); m.day = U(278, 5); m.hour = U(283, 5); m.minute = U(288, 6);
+			m.draught = U(294, 8); T(302, 120, m.destination); m.dte = U(422, 1);
+			return true;
+		}
+		case 18:
+		{
+			if (n < 168) return false;
+
+			ClassBPositionReport& m = msg.classb;
+
+			m.speed = U(46, 10); m.accuracy = U(56, 1); m.lon = S(57, 28); m.lat = S(85, 27);
+			m.course = U(112, 12); m.heading = U(124, 9); m.second = U(133, 6);
+			m.cs = U(141, 1); m.display = U(142, 1); m.dsc = U(143, 1); m.band = U(144, 1); m.msg22 = U(145, 1);
+			m.assigned = U(146, 1); m.raim = U(147, 1); m.radio = U(148, 20);
+			return true;
+		}
+		case 19:
+		{
+			if (n < 312) return false;
+
+			ClassBExtendedReport& m = msg.classb_ext;
+
+			m.speed = U(46, 10); m.accuracy = U(56, 1); m.lon = S(57, 28); m.lat = S(85, 27);
+			m.course = U(112, 12); m.heading = U(124, 9); m.second = U(133, 6);
+			T(143, 120, m.shipname); m.shiptype = U(263, 8); m.dim = D(271);
+			m.epfd = U(301, 4); m.raim = U(305, 1); m.dte = U(306, 1); m.assigned = U(307, 1);
+			return true;
+		}
+		case 21:
+		{
+			if (n < 272) return false;
+
+			AidToNavigationReport& m = msg.aton;
+
+			m.aid_type = U(38, 5); T(43, 120, m.name);
+			m.accuracy = U(163, 1); m.lon = S(164, 28); m.lat = S(192, 27); m.dim = D(219);
+			m.epfd = U(249, 4); m.second = U(253, 6); m.off_position = U(259, 1); m.regional = U(260, 8);
+			m.raim = U(268, 1); m.virtual_aid = U(269, 1); m.assigned = U(270, 1);
+
+			// the name extension follows in whole characters
+			int ext = std::min(n - 272, 84) / 6 * 6;
+			if (ext > 0) T(272, ext, m.name + strlen(m.name));
+			return true;
+		}
+		case 24:
+		{
+			StaticDataReport& m = msg.statics;
+
+			m.partno = U(38, 2);
+
+			if (m.partno == 0)
+			{
+				if (n < 160) return false;
+
+				T(40, 120, m.shipname);
+				m.shiptype = 0; m.vendorid[0] = 0; m.model = 0; m.serial = 0; m.callsign[0] = 0;
+				m.dim = { 0, 0, 0, 0 }; m.mothership_mmsi = 0;
+			}
+			else
+			{
+				if (n < 168) return false;
+
+				m.shipname[0] = 0;
+				m.shiptype = U(40, 8); T(48, 18, m.vendorid); m.model = U(66, 4); m.serial = U(70, 20); T(90, 42, m.callsign);
+
+				// auxiliary craft (MMSI 98xxxxxxx) report their mother ship instead of dimensions
+				if (msg.mmsi / 10000000 == 98)
+				{
+					m.dim = { 0, 0, 0, 0 }; m.mothership_mmsi = U(132, 30);
+				}
+				else
+				{
+					m.dim = D(132); m.mothership_mmsi = 0;
+				}
+			}
+			return true;
+		}
+		case 27:
+		{
+			if (n < 96) return false;
+
+			LongRangeReport& m = msg.longrange;
+
+			m.accuracy = U(38, 1); m.raim = U(39, 1); m.status = U(40, 4); m.lon = S(44, 18); m.lat = S(62, 17);
+			m.speed = U(79, 6); m.course = U(85, 9); m.gnss = U(94, 1);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	void PayloadDecoder::Receive(const NMEA* data, int len)
+	{
+		for (int i = 0; i < len; i++)
+			if (decode(data[i])) sendOut(&msg, 1);
+	}
+
+	// JSONWriter
+
+	void JSONWriter::key(const char* k)
+	{
+		if (n > 1) buffer[n++] = ',';
+		buffer[n++] = '"';
+		while (*k) buffer[n++] = *k++;
+		buffer[n++] = '"';
+		buffer[n++] = ':';
+	}
+
+	void JSONWriter::writeUnsigned(uint64_t v)
+	{
+		char digits[20];
+		int d = 0;
+
+		do { digits[d++] = '0' + v % 10; v /= 10; } while (v);
+		while (d) buffer[n++] = digits[--d];
+	}
+
+	void JSONWriter::number(const char* k, int64_t v)
+	{
+		key(k);
+		if (v < 0) { buffer[n++] = '-'; v = -v; }
+		writeUnsigned(v);
+	}
+
+	// v / scale with the given number of decimals, rounded half away from zero
+	void JSONWriter::fixed(const char* k, int v, int scale, int decimals)
+	{
+		static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+		key(k);
+		if (v < 0) { buffer[n++] = '-'; v = -v; }
+
+		uint64_t p = pow10[decimals];
+		uint64_t q = ((uint64_t)v * p * 2 + scale) / (2 * (uint64_t)scale);
+
+		writeUnsigned(q / p);
+		if (decimals == 0) return;
+
+		buffer[n++] = '.';
+		uint64_t f = q % p;
+		for (int i = decimals - 1; i >= 0; i--)
+		{
+			buffer[n + i] = '0' + f % 10;
+			f /= 10;
+		}
+		n += decimals;
+	}
+
+	// 6-bit ASCII has no control characters, only the quote and backslash need escaping
+	void JSONWriter::text(const char* k, const char* s)
+	{
+		key(k);
+		buffer[n++] = '"';
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\') buffer[n++] = '\\';
+			buffer[n++] = *s;
+		}
+		buffer[n++] = '"';
+	}
+
+	void JSONWriter::dimensions(const Dimensions& d)
+	{
+		number("to_bow", d.to_bow); number("to_stern", d.to_stern);
+		number("to_port", d.to_port); number("to_starboard", d.to_starboard);
+	}
+
+	void JSONWriter::write(const DecodedMessage& msg)
+	{
+		n = 0;
+		buffer[n++] = '{';
+
+		text("class", "AIS");
+		char channel[2] = { msg.channel, 0 };
+		text("channel", channel);
+		number("type", msg.type); number("repeat", msg.repeat); number("mmsi", msg.mmsi);
+
+		switch (msg.type)
+		{
+		case 1: case 2: case 3:
+		{
+			const PositionReport& m = msg.position;
+
+			number("status", m.status); number("turn", m.turn); fixed("speed", m.speed, 10, 1); number("accuracy", m.accuracy);
+			fixed("lon", m.lon, 600000, 6); fixed("lat", m.lat, 600000, 6); fixed("course", m.course, 10, 1); number("heading", m.heading);
+			number("second", m.second); number("maneuver", m.maneuver); number("raim", m.raim); number("radio", m.radio);
+			break;
+		}
+		case 4:
+		{
+			const BaseStationReport& m = msg.base;
+
+			number("year", m.year); number("month", m.month); number("day", m.day);
+			number("hour", m.hour); number("minute", m.minute); number("second", m.second);
+			number("accuracy", m.accuracy); fixed("lon", m.lon, 600000, 6); fixed("lat", m.lat, 600000, 6);
+			number("epfd", m.epfd); number("raim", m.raim); number("radio", m.radio);
+			break;
+		}
+		case 5:
+		{
+			const StaticVoyageData& m = msg.voyage;
+
+			number("ais_version", m.ais_version); number("imo", m.imo); text("callsign", m.callsign); text("shipname", m.shipname);
+			number("shiptype", m.shiptype); dimensions(m.dim); number("epfd", m.epfd);
+			number("month", m.month); number("day", m.day); number("hour", m.hour); number("minute", m.minute);
+			fixed("draught", m.draught, 10, 1); text("destination", m.destination); number("dte", m.dte);
+			break;
+		}
+		case 18:
+		{
+			const ClassBPositionReport& m = msg.classb;
+
+			fixed("speed", m.speed, 10, 1); number("accuracy", m.accuracy); fixed("lon", m.lon, 600000, 6); fixed("lat", m.lat, 600000, 6);
+			fixed("course", m.course, 10, 1); number("heading", m.heading); number("second", m.second);
+			number("cs", m.cs); number("display", m.display); number("dsc", m.dsc); number("band", m.band); number("msg22", m.msg22);
+			number("assigned", m.assigned); number("raim", m.raim); number("radio", m.radio);
+			break;
+		}
+		case 19:
+		{
+			const ClassBExtendedReport& m = msg.classb_ext;
+
+			fixed("speed", m.speed, 10, 1); number("accuracy", m.accuracy); fixed("lon", m.lon, 600000, 6); fixed("lat", m.lat, 600000, 6);
+			fixed("course", m.course, 10, 1); number("heading", m.heading); number("second", m.second);
+			text("shipname", m.shipname); number("shiptype", m.shiptype); dimensions(m.dim);
+			number("epfd", m.epfd); number("raim", m.raim); number("dte", m.dte); number("assigned", m.assigned);
+			break;
+		}
+		case 21:
+		{
+			const AidToNavigationReport& m = msg.aton;
+
+			number("aid_type", m.aid_type); text("name", m.name);
+			number("accuracy", m.accuracy); fixed("lon", m.lon, 600000, 6); fixed("lat", m.lat, 600000, 6); dimensions(m.dim);
+			number("epfd", m.epfd); number("second", m.second); number("off_position", m.off_position); number("regional", m.regional);
+			number("raim", m.raim); number("virtual_aid", m.virtual_aid); number("assigned", m.assigned);
+			break;
+		}
+		case 24:
+		{
+			const StaticDataReport& m = msg.statics;
+
+			number("partno", m.partno);
+
+			if (m.partno == 0)
+				text("shipname", m.shipname);
+			else
+			{
+				number("shiptype", m.shiptype); text("vendorid", m.vendorid); number("model", m.model); number("serial", m.serial);
+				text("callsign", m.callsign);
+
+				if (m.mothership_mmsi) number("mothership_mmsi", m.mothership_mmsi);
+				else dimensions(m.dim);
+			}
+			break;
+		}
+		case 27:
+		{
+			const LongRangeReport& m = msg.longrange;
+
+			number("accuracy", m.accuracy); number("raim", m.raim); number("status", m.status);
+			fixed("lon", m.lon, 600, 4); fixed("lat", m.lat, 600, 4);
+			number("speed", m.speed); number("course", m.course); number("gnss", m.gnss);
+			break;
+		}
+		}
+
+		buffer[n++] = '}';
+		buffer[n++] = '\n';
+	}
+
+	void JSONWriter::Receive(const DecodedMessage* data, int len)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			write(data[i]);
+			sendOut(buffer, n);
+		}
+	}
+}
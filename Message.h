@@ -0,0 +1,179 @@
+/*
+Copyright(c) 2021 jvde.github@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include "Stream.h"
+
+// Fields of the common AIS message types, read directly from the payload bits of a frame instead of
+// from the armored NMEA text. Values are kept as integers in the units of the standard (e.g. longitude
+// and latitude in 1/10000 minute, speed in 1/10 knot), text fields are null terminated ASCII.
+
+namespace AIS
+{
+	struct Dimensions
+	{
+		int to_bow, to_stern, to_port, to_starboard;
+	};
+
+	// types 1, 2 and 3
+	struct PositionReport
+	{
+		int status, turn, speed, accuracy, lon, lat, course, heading, second, maneuver, raim;
+		uint32_t radio;
+	};
+
+	// type 4
+	struct BaseStationReport
+	{
+		int year, month, day, hour, minute, second, accuracy, lon, lat, epfd, raim;
+		uint32_t radio;
+	};
+
+	// type 5
+	struct StaticVoyageData
+	{
+		int ais_version;
+		uint32_t imo;
+		char callsign[7 + 1];
+		char shipname[20 + 1];
+		int shiptype;
+		Dimensions dim;
+		int epfd, month, day, hour, minute, draught;
+		char destination[20 + 1];
+		int dte;
+	};
+
+	// type 18
+	struct ClassBPositionReport
+	{
+		int speed, accuracy, lon, lat, course, heading, second, cs, display, dsc, band, msg22, assigned, raim;
+		uint32_t radio;
+	};
+
+	// type 19
+	struct ClassBExtendedReport
+	{
+		int speed, accuracy, lon, lat, course, heading, second;
+		char shipname[20 + 1];
+		int shiptype;
+		Dimensions dim;
+		int epfd, raim, dte, assigned;
+	};
+
+	// type 21, the name extension is empty for the 272 bit variant
+	struct AidToNavigationReport
+	{
+		int aid_type;
+		char name[20 + 14 + 1];
+		int accuracy, lon, lat;
+		Dimensions dim;
+		int epfd, second, off_position, regional, raim, virtual_aid, assigned;
+	};
+
+	// type 24, part A carries the name and part B the rest
+	struct StaticDataReport
+	{
+		int partno;
+		char shipname[20 + 1];
+		int shiptype;
+		char vendorid[3 + 1];
+		int model;
+		uint32_t serial;
+		char callsign[7 + 1];
+		Dimensions dim;
+		uint32_t mothership_mmsi;
+	};
+
+	// type 27, longitude and latitude in 1/10 minute
+	struct LongRangeReport
+	{
+		int accuracy, raim, status, lon, lat, speed, course, gnss;
+	};
+
+	struct DecodedMessage
+	{
+		int type;
+		int repeat;
+		uint32_t mmsi;
+		char channel;
+
+		// frame the message was decoded from, only valid during Receive
+		const NMEA* nmea;
+
+		union
+		{
+			PositionReport position;
+			BaseStationReport base;
+			StaticVoyageData voyage;
+			ClassBPositionReport classb;
+			ClassBExtendedReport classb_ext;
+			AidToNavigationReport aton;
+			StaticDataReport statics;
+			LongRangeReport longrange;
+		};
+	};
+
+	// Frames of the supported types that are long enough are decoded and passed on, others are dropped.
+	class PayloadDecoder : public SimpleStreamInOut<NMEA, DecodedMessage>
+	{
+		DecodedMessage msg;
+
+		const uint8_t* payload = nullptr;
+
+		uint32_t U(int start, int len);
+		int S(int start, int len);
+		void T(int start, int len, char* s);
+		Dimensions D(int start);
+
+		bool decode(const NMEA& nmea);
+
+	public:
+
+		void Receive(const NMEA* data, int len);
+	};
+
+	// Decoded messages as JSON, one object per line with the field names of gpsd. Each object is written into a
+	// fixed buffer and sent on as text. Position, speed, course and draught are scaled to their natural units
+	// with fixed point arithmetic on the raw integers, so the digits are exact and no floating point is involved.
+	class JSONWriter : public SimpleStreamInOut<DecodedMessage, char>
+	{
+		// longest object (type 5) is well below this
+		static const int MaxLength = 1024;
+
+		char buffer[MaxLength];
+		int n = 0;
+
+		void key(const char* k);
+		void writeUnsigned(uint64_t v);
+		void number(const char* k, int64_t v);
+		void fixed(const char* k, int v, int scale, int decimals);
+		void text(const char* k, const char* s);
+		void dimensions(const Dimensions& d);
+
+		void write(const DecodedMessage& m);
+
+	public:
+
+		void Receive(const DecodedMessage* data, int len);
+	};
+}
@@ -24,6 +24,17 @@ SOFTWARE.
 
 namespace AIS
 {
+	void Model::ModelOutput::Receive(const NMEA* data, int len)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			nmea = data[i];
+			nmea.model = model->id;
+			nmea.offset = model->getFrequencyOffset(nmea.channel);
+			sendOut(&nmea, 1);
+		}
+	}
+
 	std::vector<uint32_t> ModelStandard::SupportedSampleRates()
 	{
 		return { 1920000, 1536000, 768000, 384000, 288000, 96000 };
@@ -31,6 +42,8 @@ namespace AIS
 
 	void ModelStandard::buildModel(int sample_rate, bool timerOn)
 	{
+		if (oversampling != 5) throw "Oversampling not available for this model.";
+
 		setName("Standard (non-coherent)");
 
 		const int nSymbolsPerSample = 48000/9600;
@@ -40,11 +53,43 @@ namespace AIS
 		FR_a.setTaps(Filters::Receiver);
 		FR_b.setTaps(Filters::Receiver);
 
-		S_a.setBuckets(nSymbolsPerSample);
-		S_b.setBuckets(nSymbolsPerSample);
+		FM_a.setPrecision(fm_precision);
+		FM_b.setPrecision(fm_precision);
+
+		// symbol timing from parallel buckets or from the interpolating sampler and its neighbours
+		const int nBuckets = timing_neighbours < 0 ? nSymbolsPerSample : 2 * timing_neighbours + 1;
 
-		DEC_a.resize(nSymbolsPerSample);
-		DEC_b.resize(nSymbolsPerSample);
+		std::vector<Connection<FLOAT32>*> bucket_a(nBuckets), bucket_b(nBuckets);
+
+		if (timing_neighbours < 0)
+		{
+			S_a.setBuckets(nSymbolsPerSample);
+			S_b.setBuckets(nSymbolsPerSample);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &S_a.out[i]; bucket_b[i] = &S_b.out[i]; }
+		}
+		else
+		{
+			TI_a.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_b.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_a.setNeighbours(timing_neighbours);
+			TI_b.setNeighbours(timing_neighbours);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &TI_a.out[i]; bucket_b[i] = &TI_b.out[i]; }
+		}
+
+		DEC_a.setLanes(nBuckets);
+		DEC_b.setLanes(nBuckets);
+		DEC_a.setChannel('A');
+		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
+		DEC_a.setPruning(bucket_pruning);
+		DEC_b.setPruning(bucket_pruning);
+		DEC_a >> output;
+		DEC_b >> output;
 
 		Connection<CFLOAT32>& physical = timerOn ? (*input >> timer).out : *input;
 
@@ -72,24 +117,30 @@ namespace AIS
 			throw "Internal error: sample rate not supported in standard model.";
 		}
 
-		ROT.up >> DS2_a >> F_a >> FM_a >> FR_a >> S_a;
-		ROT.down >> DS2_b >> F_b >> FM_b >> FR_b >> S_b;
+		ROT.up >> DS2_a >> F_a >> FM_a >> FR_a;
+		ROT.down >> DS2_b >> F_b >> FM_b >> FR_b;
 
-		for (int i = 0; i < nSymbolsPerSample; i++)
+		if (timing_neighbours < 0)
 		{
-			DEC_a[i].setChannel('A');
-			DEC_b[i].setChannel('B');
+			FR_a >> S_a;
+			FR_b >> S_b;
+		}
+		else
+		{
+			FR_a >> TI_a;
+			FR_b >> TI_b;
+		}
 
-			S_a.out[i] >> DEC_a[i] >> output;
-			S_b.out[i] >> DEC_b[i] >> output;
+		for (int i = 0; i < nBuckets; i++)
+		{
+			*bucket_a[i] >> DEC_a.in(i);
+			*bucket_b[i] >> DEC_b.in(i);
 
-			for (int j = 0; j < nSymbolsPerSample; j++)
+			// the timing loop follows the state of the decoder on the central stream
+			if (timing_neighbours >= 0 && i == timing_neighbours)
 			{
-				if (i != j)
-				{
-					DEC_a[i].DecoderMessage.Connect(DEC_a[j]);
-					DEC_b[i].DecoderMessage.Connect(DEC_b[j]);
-				}
+				DEC_a.LaneMessage(i).Connect(TI_a);
+				DEC_b.LaneMessage(i).Connect(TI_b);
 			}
 		}
 
@@ -103,6 +154,8 @@ namespace AIS
 
 	void ModelBase::buildModel(int sample_rate,bool timerOn)
 	{
+		if (oversampling != 5) throw "Oversampling not available for this model.";
+
 		setName("Base (non-coherent)");
 
 		ROT.setRotation((float)(PI * 25000.0 / 48000.0));
@@ -110,8 +163,15 @@ namespace AIS
 		FR_a.setTaps(Filters::Receiver);
 		FR_b.setTaps(Filters::Receiver);
 
+		FM_a.setPrecision(fm_precision);
+		FM_b.setPrecision(fm_precision);
+
 		DEC_a.setChannel('A');
 		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
 
 		Connection<CFLOAT32>& physical = timerOn ? (*input >> timer).out : *input;
 
@@ -158,6 +218,162 @@ namespace AIS
 	{
 		setName("AIS engine v0.12");
 
+		const int nSymbolsPerSample = oversampling;
+
+		ROT.setRotation((float)(PI * 25000.0 / 48000.0));
+
+		// receive filter and frequency search scaled to the back-end rate of nSymbolsPerSample * 9600 S/s
+		std::vector<FLOAT32> taps = nSymbolsPerSample == 5 ? Filters::Coherent : Filters::CoherentForSamplesPerSymbol(nSymbolsPerSample);
+
+		FC_a.setTaps(taps);
+		FC_b.setTaps(taps);
+
+		// symbol timing from parallel buckets or from the interpolating sampler and its neighbours
+		const int nBuckets = timing_neighbours < 0 ? nSymbolsPerSample : 2 * timing_neighbours + 1;
+
+		std::vector<Connection<CFLOAT32>*> bucket_a(nBuckets), bucket_b(nBuckets);
+
+		if (timing_neighbours < 0)
+		{
+			S_a.setBuckets(nSymbolsPerSample);
+			S_b.setBuckets(nSymbolsPerSample);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &S_a.out[i]; bucket_b[i] = &S_b.out[i]; }
+		}
+		else
+		{
+			TI_a.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_b.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_a.setNeighbours(timing_neighbours);
+			TI_b.setNeighbours(timing_neighbours);
+			TI_a.setOffset(nSymbolsPerSample / 2.0f);
+			TI_b.setOffset(nSymbolsPerSample / 2.0f);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &TI_a.out[i]; bucket_b[i] = &TI_b.out[i]; }
+		}
+
+		DEC_a.setLanes(nBuckets);
+		DEC_b.setLanes(nBuckets);
+		DEC_a.setChannel('A');
+		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
+		DEC_a.setPruning(bucket_pruning);
+		DEC_b.setPruning(bucket_pruning);
+		DEC_a >> output;
+		DEC_b >> output;
+
+		CD_a.resize(nBuckets);
+		CD_b.resize(nBuckets);
+
+		// same search range in Hz at every rate
+		const int N = nSymbolsPerSample == 10 ? 1024 : 512;
+		const int window = nSymbolsPerSample == 3 ? 141 : nSymbolsPerSample == 10 ? 443 : 375 / 2;
+
+		CGF_a.setN(N, window);
+		CGF_b.setN(N, window);
+		CGF_a.setSampleRate(9600 * nSymbolsPerSample);
+		CGF_b.setSampleRate(9600 * nSymbolsPerSample);
+
+		Connection<CFLOAT32>& physical = timerOn ? (*input >> timer).out : *input;
+
+		switch (sample_rate)
+		{
+		case 1920000:
+			physical >> DS5 >> DS2_2 >> DS2_1 >> ROT;
+			break;
+		case 1536000:
+			physical >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+			break;
+		case 768000:
+			physical >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+			break;
+		case 384000:
+			physical >> DS2_2 >> DS2_1 >> ROT;
+			break;
+		case 288000:
+			physical >> DS3 >> ROT;
+			break;
+		case 96000:
+			physical >> ROT;
+			break;
+		default:
+			throw "Internal error: sample rate not supported in default engine.";
+		}
+
+		switch (nSymbolsPerSample)
+		{
+		case 3:
+			RS_a.setRates(3, 5, 16);
+			RS_b.setRates(3, 5, 16);
+			ROT.up >> DS2_a >> F_a >> RS_a >> CGF_a >> FC_a;
+			ROT.down >> DS2_b >> F_b >> RS_b >> CGF_b >> FC_b;
+			break;
+		case 5:
+			ROT.up >> DS2_a >> F_a >> CGF_a >> FC_a;
+			ROT.down >> DS2_b >> F_b >> CGF_b >> FC_b;
+			break;
+		case 10:
+			ROT.up >> F_a >> CGF_a >> FC_a;
+			ROT.down >> F_b >> CGF_b >> FC_b;
+			break;
+		default:
+			throw "Oversampling not available for this model.";
+		}
+
+		// optionally only pass on the blocks around a detected preamble
+		BD_a.setSamplesPerSymbol(nSymbolsPerSample);
+		BD_b.setSamplesPerSymbol(nSymbolsPerSample);
+
+		Connection<CFLOAT32>& rx_a = burst_detection ? (FC_a >> BD_a).out : FC_a.out;
+		Connection<CFLOAT32>& rx_b = burst_detection ? (FC_b >> BD_b).out : FC_b.out;
+
+		if (timing_neighbours < 0)
+		{
+			rx_a >> S_a;
+			rx_b >> S_b;
+		}
+		else
+		{
+			rx_a >> TI_a;
+			rx_b >> TI_b;
+		}
+
+		for (int i = 0; i < nBuckets; i++)
+		{
+			CD_a[i].setPhaseTracking(phase_tracking);
+			CD_b[i].setPhaseTracking(phase_tracking);
+
+			*bucket_a[i] >> CD_a[i] >> DEC_a.in(i);
+			*bucket_b[i] >> CD_b[i] >> DEC_b.in(i);
+
+			DEC_a.LaneMessage(i).Connect(CD_a[i]);
+			DEC_b.LaneMessage(i).Connect(CD_b[i]);
+
+			// the timing loop follows the state of the decoder on the central stream
+			if (timing_neighbours >= 0 && i == timing_neighbours)
+			{
+				DEC_a.LaneMessage(i).Connect(TI_a);
+				DEC_b.LaneMessage(i).Connect(TI_b);
+			}
+		}
+
+		return;
+	}
+
+	std::vector<uint32_t> ModelViterbi::SupportedSampleRates()
+	{
+		return { 1920000, 1536000, 768000, 384000, 288000, 96000 };
+	}
+
+	void ModelViterbi::buildModel(int sample_rate, bool timerOn)
+	{
+		if (oversampling != 5) throw "Oversampling not available for this model.";
+
+		setName("Viterbi (MLSE, experimental)");
+
 		const int nSymbolsPerSample = 48000/9600;
 
 		ROT.setRotation((float)(PI * 25000.0 / 48000.0));
@@ -168,8 +384,18 @@ namespace AIS
 		S_a.setBuckets(nSymbolsPerSample);
 		S_b.setBuckets(nSymbolsPerSample);
 
-		DEC_a.resize(nSymbolsPerSample);
-		DEC_b.resize(nSymbolsPerSample);
+		DEC_a.setLanes(nSymbolsPerSample);
+		DEC_b.setLanes(nSymbolsPerSample);
+		DEC_a.setChannel('A');
+		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
+		DEC_a.setPruning(bucket_pruning);
+		DEC_b.setPruning(bucket_pruning);
+		DEC_a >> output;
+		DEC_b >> output;
 
 		CD_a.resize(nSymbolsPerSample);
 		CD_b.resize(nSymbolsPerSample);
@@ -200,7 +426,7 @@ namespace AIS
 			physical >> ROT;
 			break;
 		default:
-			throw "Internal error: sample rate not supported in default engine.";
+			throw "Internal error: sample rate not supported in Viterbi model.";
 		}
 
 		ROT.up >> DS2_a >> F_a >> CGF_a >> FC_a >> S_a;
@@ -208,20 +434,8 @@ namespace AIS
 
 		for (int i = 0; i < nSymbolsPerSample; i++)
 		{
-			DEC_a[i].setChannel('A');
-			DEC_b[i].setChannel('B');
-
-			S_a.out[i] >> CD_a[i] >> DEC_a[i] >> output;
-			S_b.out[i] >> CD_b[i] >> DEC_b[i] >> output;
-
-			for (int j = 0; j < nSymbolsPerSample; j++)
-			{
-				if (i != j)
-				{
-					DEC_a[i].DecoderMessage.Connect(DEC_a[j]);
-					DEC_b[i].DecoderMessage.Connect(DEC_b[j]);
-				}
-			}
+			S_a.out[i] >> CD_a[i] >> DEC_a.in(i);
+			S_b.out[i] >> CD_b[i] >> DEC_b.in(i);
 		}
 
 		return;
@@ -234,6 +448,8 @@ namespace AIS
 
 	void ModelDiscriminator::buildModel(int sample_rate, bool timerOn)
 	{
+		if (oversampling != 5) throw "Oversampling not available for this model.";
+
 		setName("FM discriminator output model");
 
 		const int nSymbolsPerSample = 48000/9600;
@@ -244,8 +460,18 @@ namespace AIS
 		S_a.setBuckets(nSymbolsPerSample);
 		S_b.setBuckets(nSymbolsPerSample);
 
-		DEC_a.resize(nSymbolsPerSample);
-		DEC_b.resize(nSymbolsPerSample);
+		DEC_a.setLanes(nSymbolsPerSample);
+		DEC_b.setLanes(nSymbolsPerSample);
+		DEC_a.setChannel('A');
+		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
+		DEC_a.setPruning(bucket_pruning);
+		DEC_b.setPruning(bucket_pruning);
+		DEC_a >> output;
+		DEC_b >> output;
 
 		Connection<CFLOAT32>& physical = timerOn ? (*input >> timer).out : *input;
 
@@ -264,20 +490,8 @@ namespace AIS
 
 		for (int i = 0; i < nSymbolsPerSample; i++)
 		{
-			S_a.out[i] >> DEC_a[i] >> output;
-			S_b.out[i] >> DEC_b[i] >> output;
-
-			DEC_a[i].setChannel('A');
-			DEC_b[i].setChannel('B');
-
-			for (int j = 0; j < nSymbolsPerSample; j++)
-			{
-				if (i != j)
-				{
-					DEC_a[i].DecoderMessage.Connect(DEC_a[j]);
-					DEC_b[i].DecoderMessage.Connect(DEC_b[j]);
-				}
-			}
+			S_a.out[i] >> DEC_a.in(i);
+			S_b.out[i] >> DEC_b.in(i);
 		}
 
 		return;
@@ -292,23 +506,62 @@ namespace AIS
 	{
 		setName("Challenger model (experimental)");
 
-		const int nSymbolsPerSample = 48000 / 9600;
+		const int nSymbolsPerSample = oversampling;
 		ROT.setRotation((float)(PI * 25000.0 / 48000.0));
 
-		FR_a.setTaps(Filters::Coherent);
-		FR_b.setTaps(Filters::Coherent);
+		// receive filter and frequency search scaled to the back-end rate of nSymbolsPerSample * 9600 S/s
+		std::vector<FLOAT32> taps = nSymbolsPerSample == 5 ? Filters::Coherent : Filters::CoherentForSamplesPerSymbol(nSymbolsPerSample);
 
-		S_a.setBuckets(nSymbolsPerSample);
-		S_b.setBuckets(nSymbolsPerSample);
+		FR_a.setTaps(taps);
+		FR_b.setTaps(taps);
 
-		DEC_a.resize(nSymbolsPerSample);
-		DEC_b.resize(nSymbolsPerSample);
+		// symbol timing from parallel buckets or from the interpolating sampler and its neighbours
+		const int nBuckets = timing_neighbours < 0 ? nSymbolsPerSample : 2 * timing_neighbours + 1;
 
-		CD_a.resize(nSymbolsPerSample);
-		CD_b.resize(nSymbolsPerSample);
+		std::vector<Connection<CFLOAT32>*> bucket_a(nBuckets), bucket_b(nBuckets);
 
-		CGF_a.setN(4096,0);
-		CGF_b.setN(4096,0);
+		if (timing_neighbours < 0)
+		{
+			S_a.setBuckets(nSymbolsPerSample);
+			S_b.setBuckets(nSymbolsPerSample);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &S_a.out[i]; bucket_b[i] = &S_b.out[i]; }
+		}
+		else
+		{
+			TI_a.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_b.setSamplesPerSymbol(nSymbolsPerSample);
+			TI_a.setNeighbours(timing_neighbours);
+			TI_b.setNeighbours(timing_neighbours);
+			TI_a.setOffset(nSymbolsPerSample / 2.0f);
+			TI_b.setOffset(nSymbolsPerSample / 2.0f);
+
+			for (int i = 0; i < nBuckets; i++) { bucket_a[i] = &TI_a.out[i]; bucket_b[i] = &TI_b.out[i]; }
+		}
+
+		DEC_a.setLanes(nBuckets);
+		DEC_b.setLanes(nBuckets);
+		DEC_a.setChannel('A');
+		DEC_b.setChannel('B');
+		DEC_a.setRepair(repair_bits, &repair_stats);
+		DEC_a.setCorrection(correct_bits);
+		DEC_b.setRepair(repair_bits, &repair_stats);
+		DEC_b.setCorrection(correct_bits);
+		DEC_a.setPruning(bucket_pruning);
+		DEC_b.setPruning(bucket_pruning);
+		DEC_a >> output;
+		DEC_b >> output;
+
+		CD_a.resize(nBuckets);
+		CD_b.resize(nBuckets);
+
+		CGF_a.setN(nSymbolsPerSample == 10 ? 8192 : 4096, 0);
+		CGF_b.setN(nSymbolsPerSample == 10 ? 8192 : 4096, 0);
+		CGF_a.setSampleRate(9600 * nSymbolsPerSample);
+		CGF_b.setSampleRate(9600 * nSymbolsPerSample);
+
+		CGF_a.setTracking(12);
+		CGF_b.setTracking(12);
 
 		Connection<CFLOAT32>& physical = timerOn ? (*input >> timer).out : *input;
 
@@ -336,28 +589,61 @@ namespace AIS
 			throw "Internal error: sample rate not supported in default engine.";
 		}
 
-		ROT.up >> DS2_a >> F_a >> CGF_a >> FR_a >> S_a;
-		ROT.down >> DS2_b >> F_b >> CGF_b >> FR_b >> S_b;
+		switch (nSymbolsPerSample)
+		{
+		case 3:
+			RS_a.setRates(3, 5, 16);
+			RS_b.setRates(3, 5, 16);
+			ROT.up >> DS2_a >> F_a >> RS_a >> CGF_a >> FR_a;
+			ROT.down >> DS2_b >> F_b >> RS_b >> CGF_b >> FR_b;
+			break;
+		case 5:
+			ROT.up >> DS2_a >> F_a >> CGF_a >> FR_a;
+			ROT.down >> DS2_b >> F_b >> CGF_b >> FR_b;
+			break;
+		case 10:
+			ROT.up >> F_a >> CGF_a >> FR_a;
+			ROT.down >> F_b >> CGF_b >> FR_b;
+			break;
+		default:
+			throw "Oversampling not available for this model.";
+		}
 
-		for (int i = 0; i < nSymbolsPerSample; i++)
+		// optionally only pass on the blocks around a detected preamble
+		BD_a.setSamplesPerSymbol(nSymbolsPerSample);
+		BD_b.setSamplesPerSymbol(nSymbolsPerSample);
+
+		Connection<CFLOAT32>& rx_a = burst_detection ? (FR_a >> BD_a).out : FR_a.out;
+		Connection<CFLOAT32>& rx_b = burst_detection ? (FR_b >> BD_b).out : FR_b.out;
+
+		if (timing_neighbours < 0)
+		{
+			rx_a >> S_a;
+			rx_b >> S_b;
+		}
+		else
 		{
-			S_a.out[i] >> CD_a[i] >> DEC_a[i] >> output;
-			S_b.out[i] >> CD_b[i] >> DEC_b[i] >> output;
+			rx_a >> TI_a;
+			rx_b >> TI_b;
+		}
 
-			DEC_a[i].setChannel('A');
-			DEC_b[i].setChannel('B');
+		for (int i = 0; i < nBuckets; i++)
+		{
+			*bucket_a[i] >> CD_a[i] >> DEC_a.in(i);
+			*bucket_b[i] >> CD_b[i] >> DEC_b.in(i);
 
-			for (int j = 0; j < nSymbolsPerSample; j++)
+			// the timing loop follows the state of the decoder on the central stream
+			if (timing_neighbours >= 0 && i == timing_neighbours)
 			{
-				if (i != j)
-				{
-					DEC_a[i].DecoderMessage.Connect(DEC_a[j]);
-					DEC_b[i].DecoderMessage.Connect(DEC_b[j]);
-				}
+				DEC_a.LaneMessage(i).Connect(TI_a);
+				DEC_b.LaneMessage(i).Connect(TI_b);
 			}
 
-			DEC_a[i].DecoderMessage.Connect(CD_a[i]);
-			DEC_b[i].DecoderMessage.Connect(CD_b[i]);
+			DEC_a.LaneMessage(i).Connect(CD_a[i]);
+			DEC_b.LaneMessage(i).Connect(CD_b[i]);
+
+			CD_a[i].FrequencyMessage.Connect(CGF_a);
+			CD_b[i].FrequencyMessage.Connect(CGF_b);
 		}
 
 		return;
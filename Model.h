@@ -36,11 +36,34 @@ namespace AIS
 	{
 	protected:
 
+		// frames leave the model with the model and the frequency offset of their channel filled in
+		class ModelOutput : public SimpleStreamInOut<NMEA, NMEA>
+		{
+			Model* model;
+			NMEA nmea;
+
+		public:
+			ModelOutput(Model* m) : model(m) {}
+			void Receive(const NMEA* data, int len);
+		};
+
 		std::string name;
+		int id = 0;
 		Device::Control* control;
 		Connection<CFLOAT32>* input;
 		Util::Timer<CFLOAT32> timer;
-		Util::PassThrough<NMEA> output;
+		ModelOutput output = ModelOutput(this);
+
+		DSP::FMPrecision fm_precision = DSP::FMPrecision::HIGH;
+		bool phase_tracking = false;
+
+		int repair_bits = 0;
+		int correct_bits = 0;
+		int timing_neighbours = -1;
+		bool bucket_pruning = false;
+		int oversampling = 5;
+		bool burst_detection = false;
+		AIS::RepairStatistics repair_stats;
 
 	public:
 
@@ -56,8 +79,23 @@ namespace AIS
 		StreamOut<NMEA>& Output() { return output; }
 
 		void setName(std::string s) { name = s; }
+		void setID(int n) { id = n; }
+		void setFMPrecision(DSP::FMPrecision p) { fm_precision = p; }
+		void setPhaseTracking(bool b) { phase_tracking = b; }
+		void setRepairBits(int n) { repair_bits = n; }
+		void setCorrectBits(int n) { correct_bits = n; }
+		void setTimingRecovery(int n) { timing_neighbours = n; }
+		void setBucketPruning(bool b) { bucket_pruning = b; }
+		void setOversampling(int n) { oversampling = n; }
+		void setBurstDetection(bool b) { burst_detection = b; }
+		const AIS::RepairStatistics& getRepairStatistics() { return repair_stats; }
 		std::string getName() { return name; }
 
+		virtual FLOAT32 getFrequencyOffset(char channel) { return 0.0f; }
+
+		// blocks seen and passed on by the burst detector
+		virtual void getBurstStatistics(uint64_t& blocks, uint64_t& forwarded) { blocks = forwarded = 0; }
+
 		float getTotalTiming() { return timer.getTotalTiming(); }
 	};
 
@@ -78,8 +116,9 @@ namespace AIS
 		DSP::FMDemodulation FM_a, FM_b;
 
 		DSP::Filter FR_a, FR_b;
-		std::vector<AIS::Decoder> DEC_a, DEC_b;
+		AIS::DecoderParallel DEC_a, DEC_b;
 		DSP::SamplerParallel S_a, S_b;
+		DSP::SamplerInterpolating<FLOAT32> TI_a, TI_b;
 
 	public:
 		ModelStandard(Device::Control* c, Connection<CFLOAT32>* i) : Model(c, i) {}
@@ -122,17 +161,50 @@ namespace AIS
 		DSP::FilterCIC5 F_a, F_b;
 		DSP::SquareFreqOffsetCorrection CGF_a, CGF_b;
 		DSP::Rotate ROT;
+		DSP::ResampleComplex RS_a, RS_b;
 		std::vector<DSP::CoherentDemodulation> CD_a, CD_b;
 
 		DSP::FilterComplex FC_a, FC_b;
-		std::vector<AIS::Decoder> DEC_a, DEC_b;
+		AIS::DecoderParallel DEC_a, DEC_b;
 		DSP::SamplerParallelComplex S_a, S_b;
+		DSP::SamplerInterpolating<CFLOAT32> TI_a, TI_b;
+		DSP::BurstDetector BD_a, BD_b;
 
 	public:
 		ModelCoherent(Device::Control* c, Connection<CFLOAT32>* i) : Model(c, i) {}
 		std::vector<uint32_t> SupportedSampleRates();
 
 		void buildModel(int,bool);
+		FLOAT32 getFrequencyOffset(char channel) { return channel == 'A' ? CGF_a.getOffset() : CGF_b.getOffset(); }
+		void getBurstStatistics(uint64_t& blocks, uint64_t& forwarded)
+		{
+			blocks = BD_a.getBlocks() + BD_b.getBlocks();
+			forwarded = BD_a.getForwarded() + BD_b.getForwarded();
+		}
+	};
+
+	// coherent model with maximum likelihood sequence estimation (Viterbi) instead of symbol by symbol decisions
+	class ModelViterbi : public Model
+	{
+		DSP::Downsample3Complex DS3;
+		DSP::Downsample5Complex DS5;
+		DSP::Downsample2CIC5 DS2_1, DS2_2, DS2_3, DS2_4;
+		DSP::Downsample2CIC5 DS2_a, DS2_b;
+		DSP::FilterCIC5 F_a, F_b;
+		DSP::SquareFreqOffsetCorrection CGF_a, CGF_b;
+		DSP::Rotate ROT;
+		std::vector<DSP::ViterbiDemodulation> CD_a, CD_b;
+
+		DSP::FilterComplex FC_a, FC_b;
+		AIS::DecoderParallel DEC_a, DEC_b;
+		DSP::SamplerParallelComplex S_a, S_b;
+
+	public:
+		ModelViterbi(Device::Control* c, Connection<CFLOAT32>* i) : Model(c, i) {}
+		std::vector<uint32_t> SupportedSampleRates();
+
+		void buildModel(int,bool);
+		FLOAT32 getFrequencyOffset(char channel) { return channel == 'A' ? CGF_a.getOffset() : CGF_b.getOffset(); }
 	};
 
 	// Standard demodulation model for FM demodulated files
@@ -143,7 +215,7 @@ namespace AIS
 		Util::ImaginaryPart IP;
 
 		DSP::Filter FR_a, FR_b;
-		std::vector<AIS::Decoder> DEC_a, DEC_b;
+		AIS::DecoderParallel DEC_a, DEC_b;
 		DSP::SamplerParallel S_a, S_b;
 
 	public:
@@ -164,16 +236,25 @@ namespace AIS
 		DSP::FilterCIC5 F_a, F_b;
 		DSP::SquareFreqOffsetCorrection CGF_a, CGF_b;
 		DSP::Rotate ROT;
+		DSP::ResampleComplex RS_a, RS_b;
 		std::vector<DSP::ChallengerDemodulation> CD_a, CD_b;
 		DSP::FilterComplex FR_a, FR_b;
-		std::vector<AIS::Decoder> DEC_a, DEC_b;
+		AIS::DecoderParallel DEC_a, DEC_b;
 		DSP::SamplerParallelComplex S_a, S_b;
+		DSP::SamplerInterpolating<CFLOAT32> TI_a, TI_b;
+		DSP::BurstDetector BD_a, BD_b;
 
 	public:
 		ModelChallenger(Device::Control* c, Connection<CFLOAT32>* i) : Model(c, i) {}
 		std::vector<uint32_t> SupportedSampleRates();
 
 		void buildModel(int, bool);
+		FLOAT32 getFrequencyOffset(char channel) { return channel == 'A' ? CGF_a.getOffset() : CGF_b.getOffset(); }
+		void getBurstStatistics(uint64_t& blocks, uint64_t& forwarded)
+		{
+			blocks = BD_a.getBlocks() + BD_b.getBlocks();
+			forwarded = BD_a.getForwarded() + BD_b.getForwarded();
+		}
 	};
 
 }
@@ -25,9 +25,12 @@ SOFTWARE.
 #include <iostream>
 #include <vector>
 
-enum class DecoderMessages { StopTraining, StartTraining, Reset };
+enum class DecoderMessages { StopTraining, StartTraining, Reset, Suspend };
 enum class SystemMessage { Stop };
 
+// residual frequency offset (Hz) measured over a frame that passed the CRC
+struct FrequencyCorrection { float offset; int symbols; };
+
 template<typename T>
 class MessageIn
 {
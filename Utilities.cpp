@@ -47,4 +47,63 @@ namespace Util
 
 		sendOut(output.data(), len);
 	}
+
+	void Deduplicate::setInputs(int n)
+	{
+		if (n > MaxInputs) throw "Too many inputs for duplicate suppression.";
+
+		table.assign(TableSize, { 0, 0, 0 });
+		caught.assign(n, 0);
+		first.assign(n, 0);
+
+		inputs.clear();
+		for (int k = 0; k < n; k++) inputs.push_back(Input(this, k));
+	}
+
+	// FNV-1a over the payload bytes and length, the channel is left out so a frame on A and B is one frame
+	uint64_t Deduplicate::Hash(const NMEA& nmea)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)nmea.nBits;
+		int nBytes = (nmea.nBits + 7) / 8;
+
+		for (int i = 0; i < nBytes; i++)
+			h = (h ^ nmea.payload[i]) * 0x100000001b3ULL;
+
+		return h;
+	}
+
+	void Deduplicate::receiveInput(int k, const NMEA& nmea)
+	{
+		uint64_t h = Hash(nmea);
+
+		caught[k]++;
+
+		// probe for the frame, remember the first free (or expired) slot and otherwise the oldest
+		int slot = -1, oldest = -1;
+
+		for (int i = 0; i < MaxProbe; i++)
+		{
+			int idx = (int)((h + i) & (TableSize - 1));
+			Entry& e = table[idx];
+
+			// the models deliver out of step, so the window extends either side
+			int64_t dt = (int64_t)(nmea.start - e.start);
+			bool expired = e.inputs == 0 || dt > Window || dt < -Window;
+
+			if (!expired && e.hash == h)
+			{
+				e.inputs |= (uint32_t)1 << k;
+				return;
+			}
+
+			if (expired && slot < 0) slot = idx;
+			if (oldest < 0 || e.start < table[oldest].start) oldest = idx;
+		}
+
+		Entry& e = table[slot >= 0 ? slot : oldest];
+		e = { h, nmea.start, (uint32_t)1 << k };
+
+		first[k]++;
+		sendOut(&nmea, 1);
+	}
 }
@@ -76,4 +76,49 @@ namespace Util
 
 		float getTotalTiming() { return timing; }
 	};
+
+	// Merges the NMEA streams of several models and forwards each frame once. Frames are identified by a hash
+	// of the payload bits and remembered for Window in a fixed size open addressing table, an entry that is
+	// older than Window counts as empty. The table records which inputs caught each frame.
+	class Deduplicate : public SimpleStreamInOut<NMEA, NMEA>
+	{
+		class Input : public StreamIn<NMEA>
+		{
+			Deduplicate* parent;
+			int input;
+
+		public:
+			Input(Deduplicate* p, int k) : parent(p), input(k) {}
+			void Receive(const NMEA* data, int len) { for (int i = 0; i < len; i++) parent->receiveInput(input, data[i]); }
+		};
+
+		struct Entry
+		{
+			uint64_t hash;
+			uint64_t start;
+			uint32_t inputs;
+		};
+
+		static const int MaxInputs = 32;
+		static const int TableSize = 1024;
+		static const int MaxProbe = 16;
+		// one second in stream time, the start symbols of the models count from the same input stream at 9600/s
+		static const int64_t Window = 9600;
+
+		std::vector<Entry> table;
+		std::vector<Input> inputs;
+		std::vector<uint64_t> caught, first;
+
+		static uint64_t Hash(const NMEA& nmea);
+		void receiveInput(int k, const NMEA& nmea);
+
+	public:
+
+		void setInputs(int n);
+		StreamIn<NMEA>& in(int k) { return inputs[k]; }
+
+		// frames received from input k and frames forwarded because input k was the first to catch them
+		uint64_t getCaught(int k) { return caught[k]; }
+		uint64_t getFirst(int k) { return first[k]; }
+	};
 }